@@ -10,19 +10,36 @@
 
 #include <whirl/node/time/jiffies.hpp>
 
+#include <set>
+#include <stdexcept>
+
 namespace rsm {
 
+// Replicas evicted session of this client, see rsm.sessions.capacity
+// Command was not applied, client cannot continue: make a new one
+struct SessionExpiredError : std::runtime_error {
+  explicit SessionExpiredError(const std::string& client_id)
+      : std::runtime_error("Session of client " + client_id + " expired") {
+  }
+};
+
 // Blocking client for RSM
+// First command opens client session on replicas
 
 class Client {
  public:
   explicit Client(commute::rpc::IChannelPtr proxies);
 
+  // Throws SessionExpiredError
   muesli::Bytes Execute(std::string type, muesli::Bytes request, bool readonly);
 
  private:
+  muesli::Bytes Send(std::string type, muesli::Bytes request, bool readonly);
+
   void GenerateClientId();
   RequestId NextRequestId();
+  // All requests up to this index are completed
+  uint64_t AckedIndex() const;
 
   commute::rpc::TraceId MakeTraceId(const Command& cmd);
 
@@ -31,6 +48,8 @@ class Client {
 
   std::string client_id_;
   uint64_t request_index_{0};
+  std::set<uint64_t> in_flight_;
+  bool session_opened_{false};
 };
 
 }  // namespace rsm
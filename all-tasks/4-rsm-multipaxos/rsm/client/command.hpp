@@ -27,9 +27,17 @@ struct Command {
   // Command metadata
   bool readonly;
 
-  MUESLI_SERIALIZABLE(type, request, request_id, readonly);
+  // Client has got responses for all its requests up to this index,
+  // replicas discard them
+  uint64_t acked_index{0};
+
+  MUESLI_SERIALIZABLE(type, request, request_id, readonly, acked_index);
 };
 
+// Type of the first command of every client, opens client session
+// on replicas, see SessionTable
+inline const std::string kOpenSession = "RSM.OpenSession";
+
 //////////////////////////////////////////////////////////////////////
 
 inline bool operator==(const Command& lhs, const Command& rhs) {
@@ -18,7 +18,7 @@ ProxyClient::ProxyClient(const std::string& rsm_pool_name)
   ConnectToRSM(rsm_pool_name);
 }
 
-muesli::Bytes ProxyClient::Execute(const Command& command) {
+Response ProxyClient::Execute(const Command& command) {
   size_t attempt = 0;
 
   while (true) {
@@ -57,8 +57,7 @@ muesli::Bytes ProxyClient::Execute(const Command& command) {
 
     if (rsm_response.index() == 0) {
       // Ok
-      auto ok = std::get<0>(rsm_response);
-      return ok.response;
+      return rsm_response;
     } else if (rsm_response.index() == 1) {
       // Redirect to leader
       RedirectToLeader redirect = std::get<1>(rsm_response);
@@ -72,6 +71,11 @@ muesli::Bytes ProxyClient::Execute(const Command& command) {
       ForgetLeader();
       node::rt::SleepFor(50_jfs);
       continue;
+    } else if (rsm_response.index() == 3) {
+      // Session expired, surfaced by client
+      LOG_INFO("Session of client {} expired",
+               std::get<3>(rsm_response).client_id);
+      return rsm_response;
     }
   }
 }
@@ -3,6 +3,7 @@
 #include <timber/log.hpp>
 
 #include <rsm/client/command.hpp>
+#include <rsm/replica/response.hpp>
 
 #include <muesli/serialize.hpp>
 
@@ -20,7 +21,8 @@ class ProxyClient {
  public:
   explicit ProxyClient(const std::string& rsm_pool_name);
 
-  muesli::Bytes Execute(const Command& cmd);
+  // Ack or SessionExpired
+  Response Execute(const Command& cmd);
 
  private:
   void ConnectToRSM(const std::string& pool_name);
@@ -12,7 +12,7 @@ class ProxyService : public commute::rpc::ServiceBase<ProxyService> {
       : client_(rsm_pool_name) {
   }
 
-  muesli::Bytes Execute(Command command) {
+  Response Execute(Command command) {
     // Forward request to RSM replica
     return client_.Execute(std::move(command));
   }
@@ -2,6 +2,7 @@
 #include <rsm/replica/paxos/proposer.hpp>
 #include <rsm/replica/paxos/acceptor.hpp>
 
+#include <rsm/replica/sessions.hpp>
 #include <rsm/replica/store/log.hpp>
 
 #include <commute/rpc/call.hpp>
@@ -34,15 +35,17 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
       : Peer(node::rt::Config()),
         state_machine_(std::move(state_machine)),
         log_(store_dir),
+        sessions_capacity_(
+            node::rt::Config()->GetInt<size_t>("rsm.sessions.capacity")),
         logger_("Replica", node::rt::LoggerBackend()) {
     Start(server);
   }
 
   Future<Response> Execute(Command command) override {
     auto guard = mutex_.Guard();
-    if (cache_.find(command.request_id) != cache_.end()) {
+    if (auto response = sessions_.Find(command.request_id)) {
       auto [future, promise] = await::futures::MakeContract<Response>();
-      std::move(promise).SetValue(Ack{cache_[command.request_id]});
+      std::move(promise).SetValue(Ack{*response});
       return std::move(future);
     }
     if (node::rt::HostName() != leader_) {
@@ -59,8 +62,7 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
             break;
           } else {
             LOG_INFO("Executing command {}", entry->command.value());
-            auto response = state_machine_->Apply(entry->command.value());
-            cache_[entry->command.value().request_id] = response;
+            Apply(entry->command.value());
             ++index_;
           }
         }
@@ -90,15 +92,13 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
         break;
       }
       LOG_INFO("Executing command {}", res);
-      auto response = state_machine_->Apply(res);
-      cache_[res.request_id] = response;
+      Apply(res);
     }
 
     auto [future, promise] = await::futures::MakeContract<Response>();
     LOG_INFO("Executing command {}", command);
-    auto response = state_machine_->Apply(command);
-    cache_[command.request_id] = response;
-    std::move(promise).SetValue(Ack{response});
+    auto response = Apply(command);
+    std::move(promise).SetValue(std::move(response));
 
     return std::move(future);
   };
@@ -118,8 +118,7 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
           break;
         } else {
           LOG_INFO("Executing command {}", entry->command.value());
-          auto response = state_machine_->Apply(entry->command.value());
-          cache_[entry->command.value().request_id] = response;
+          Apply(entry->command.value());
           ++index_;
         }
       }
@@ -153,6 +152,25 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
     rpc_server->RegisterService("Acceptor", acceptor_);
   }
 
+  // Applies chosen command once, retries get recorded response
+  // Commands of evicted sessions are rejected, see SessionTable
+  Response Apply(const Command& command) {
+    switch (sessions_.Admit(command, sessions_capacity_)) {
+      case SessionTable::Status::Expired:
+        return SessionExpired{command.request_id.client_id};
+      case SessionTable::Status::Duplicate:
+        return Ack{sessions_.Find(command.request_id).value()};
+      case SessionTable::Status::New:
+        break;
+    }
+    muesli::Bytes response;
+    if (command.type != kOpenSession) {
+      response = state_machine_->Apply(command);
+    }
+    sessions_.Record(command, response);
+    return Ack{std::move(response)};
+  }
+
   void UpdateLeader(std::string& new_leader) override {
     if (new_leader > leader_) {
       leader_ = new_leader;
@@ -175,7 +193,9 @@ class MultiPaxos : public IReplica, public whirl::node::cluster::Peer {
   std::string leader_{node::rt::HostName()};
   size_t leader_timeout_{0};
 
-  std::map<rsm::RequestId, muesli::Bytes> cache_;
+  // Exactly-once semantics
+  SessionTable sessions_;
+  size_t sessions_capacity_;
 
   await::fibers::Mutex mutex_;
   await::fibers::Mutex log_mutex_;
@@ -37,6 +37,17 @@ using NotALeader = muesli::EmptyMessage;
 
 //////////////////////////////////////////////////////////////////////
 
-using Response = std::variant<Ack, RedirectToLeader, NotALeader>;
+// Client session was evicted, see SessionTable
+// Command is rejected instead of being applied twice
+struct SessionExpired {
+  std::string client_id;
+
+  MUESLI_SERIALIZABLE(client_id);
+};
+
+//////////////////////////////////////////////////////////////////////
+
+using Response =
+    std::variant<Ack, RedirectToLeader, NotALeader, SessionExpired>;
 
 }  // namespace rsm
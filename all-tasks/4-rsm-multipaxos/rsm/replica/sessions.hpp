@@ -0,0 +1,79 @@
+#pragma once
+
+#include <rsm/client/command.hpp>
+
+#include <muesli/bytes.hpp>
+#include <muesli/serializable.hpp>
+
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+
+#include <map>
+#include <optional>
+#include <string>
+
+namespace rsm {
+
+// Per-client sessions for exactly-once semantics
+// Client opens its session with kOpenSession command, response is kept
+// until client acknowledges it (Command::acked_index)
+// Opening a session above capacity evicts the least recently active one.
+// Commands of evicted session are rejected (SessionExpired), never
+// applied twice: capacity bounds the number of concurrent clients
+// Replicated state: update in log order only, so that all replicas
+// evict the same sessions
+
+class SessionTable {
+ public:
+  enum class Status {
+    // Not applied yet
+    New,
+    // Already applied, response is in Find
+    Duplicate,
+    // Client has no session, command must be rejected
+    Expired,
+  };
+
+  // Called for each command in log order before it is applied
+  // Opens or renews session of command client, drops acknowledged
+  // responses, evicts sessions above capacity
+  Status Admit(const Command& command, size_t capacity);
+
+  // Response of applied request, empty if client has already acknowledged
+  // it; std::nullopt if request was not applied
+  std::optional<muesli::Bytes> Find(const RequestId& id) const;
+
+  // Records response of command admitted as New
+  // No-op if session was evicted by commands admitted since
+  void Record(const Command& command, muesli::Bytes response);
+
+  size_t Size() const {
+    return sessions_.size();
+  }
+
+  MUESLI_SERIALIZABLE(sessions_, activity_, clock_)
+
+ private:
+  struct Session {
+    // Client has got responses for all requests up to this index
+    uint64_t acked_index{0};
+    // Request index -> response, for indices above acked_index
+    std::map<uint64_t, muesli::Bytes> responses;
+    // Value of clock_ at last update
+    uint64_t last_active{0};
+
+    MUESLI_SERIALIZABLE(acked_index, responses, last_active)
+  };
+
+  void Evict(size_t capacity);
+
+ private:
+  // Client id -> session
+  std::map<std::string, Session> sessions_;
+  // Last active -> client id, for eviction
+  std::map<uint64_t, std::string> activity_;
+  // Bumped on each recorded command
+  uint64_t clock_{0};
+};
+
+}  // namespace rsm
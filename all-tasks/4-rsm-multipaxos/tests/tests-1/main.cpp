@@ -163,6 +163,7 @@ size_t RunSimulation(size_t seed) {
 
   // For rsm
   world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
 
   // For paxos
   world.SetGlobal<int64_t>("config.paxos.backoff.init", 100);
@@ -0,0 +1,241 @@
+#include <kv/main.hpp>
+#include <kv/operations.hpp>
+#include <rsm/client/command.hpp>
+#include <rsm/replica/response.hpp>
+#include <rsm/proxy/main.hpp>
+
+// Node
+#include <whirl/node/runtime/shortcuts.hpp>
+
+// Serialization
+#include <muesli/serialize.hpp>
+// Support std::string serialization
+#include <cereal/types/string.hpp>
+
+// Logging
+#include <timber/log.hpp>
+
+// Concurrency
+#include <await/fibers/core/api.hpp>
+#include <await/fibers/sync/future.hpp>
+
+// RPC
+#include <commute/rpc/call.hpp>
+#include <commute/rpc/id.hpp>
+
+// Simulation
+#include <matrix/facade/world.hpp>
+#include <matrix/world/global/vars.hpp>
+#include <matrix/world/global/time.hpp>
+#include <matrix/client/rpc.hpp>
+#include <matrix/test/random.hpp>
+#include <matrix/test/main.hpp>
+#include <matrix/test/event_log.hpp>
+#include <matrix/test/runner.hpp>
+
+#include <tests/time_models/async.hpp>
+
+using namespace whirl;
+
+// Session eviction: opening sessions above `rsm.sessions.capacity`
+// evicts least recently active one, retry of evicted client is rejected
+// (SessionExpired), so that every command is applied exactly once
+
+//////////////////////////////////////////////////////////////////////
+
+// Executes command with given request id, so that it can be retried
+rsm::Response Execute(commute::rpc::IChannelPtr channel,
+                      const rsm::Command& command) {
+  auto f = commute::rpc::Call("RSM.Execute")
+               .Args(command)
+               .Via(channel)
+               .AtLeastOnce()
+               .Start()
+               .As<rsm::Response>();
+  return await::fibers::Await(std::move(f)).ValueOrThrow();
+}
+
+// Commands of client are rejected until it opens session (index 1)
+void OpenSession(commute::rpc::IChannelPtr channel, std::string client_id) {
+  Execute(channel, {rsm::kOpenSession, {}, {std::move(client_id), 1},
+                    /*readonly=*/false});
+}
+
+rsm::Command MakeSet(std::string client_id, kv::Value value) {
+  kv::Set::Request request{"key", std::move(value)};
+  return {kv::Set::Type(), muesli::Serialize(request),
+          {std::move(client_id), 2}, /*readonly=*/false};
+}
+
+// Client must have open session
+kv::Value Get(commute::rpc::IChannelPtr channel, std::string client_id) {
+  kv::Get::Request request{"key"};
+  rsm::Command command{kv::Get::Type(), muesli::Serialize(request),
+                       {std::move(client_id), 3}, /*readonly=*/true};
+  auto response = std::get<rsm::Ack>(Execute(channel, command)).response;
+  return muesli::Deserialize<kv::Get::Response>(response).value;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void Client() {
+  await::fibers::self::SetName("main");
+
+  node::rt::SleepFor(123_jfs);
+
+  timber::Logger logger_{"Client", node::rt::LoggerBackend()};
+
+  auto channel = matrix::client::MakeRpcChannel("proxy", 42);
+
+  size_t capacity = matrix::GetGlobal<size_t>("sessions_capacity");
+
+  // Never acknowledged, so replicas keep the response while session lives
+  auto retried = MakeSet("retried", "retried");
+  OpenSession(channel, "retried");
+  Execute(channel, retried);
+  OpenSession(channel, "overwrite");
+  Execute(channel, MakeSet("overwrite", "overwrite-1"));
+
+  // Session is alive: retry is deduplicated
+  auto response = Execute(channel, retried);
+  if (std::holds_alternative<rsm::Ack>(response) &&
+      Get(channel, "overwrite") == "overwrite-1") {
+    matrix::GlobalCounter("deduplicated").Increment();
+  }
+
+  // Open `capacity` more sessions, session of "retried" is evicted
+  std::string last_client;
+  for (size_t i = 0; i < capacity; ++i) {
+    last_client = "evict-" + std::to_string(i);
+    OpenSession(channel, last_client);
+    Execute(channel, MakeSet(last_client, "overwrite-2"));
+  }
+
+  // Session is evicted: retry is rejected, not applied once again
+  response = Execute(channel, retried);
+  if (std::holds_alternative<rsm::SessionExpired>(response)) {
+    matrix::GlobalCounter("rejected").Increment();
+  }
+  if (Get(channel, last_client) == "overwrite-2") {
+    matrix::GlobalCounter("applied_once").Increment();
+  }
+
+  matrix::GlobalCounter("done").Increment();
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Seed -> simulation digest
+// Deterministic
+size_t RunSimulation(size_t seed) {
+  auto& runner = matrix::TestRunner::Access();
+
+  static const Jiffies kTimeLimit = 128000_jfs;
+
+  runner.Verbose() << "Simulation seed: " << seed << std::endl;
+
+  matrix::Random random{seed};
+
+  // Randomize simulation parameters
+  const size_t replicas = random.Get(3, 5);
+  const size_t capacity = random.Get(2, 4);
+
+  runner.Verbose() << "Parameters: "
+      << "replicas = " << replicas << ", "
+      << "capacity = " << capacity
+      << std::endl;
+
+  // Reset RPC ids
+  commute::rpc::ResetIds();
+
+  matrix::facade::World world{seed};
+
+  runner.Configure(world);
+
+  world.SetTimeModel(tests::MakeAsyncTimeModel());
+
+  // Cluster
+  world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
+  world.MakePool("proxy", rsm::ProxyMain).Size(1);
+
+  // Clients
+  world.AddClients(Client, /*count=*/1);
+
+  // Globals
+  world.SetGlobal("sessions_capacity", capacity);
+
+  world.InitCounter("deduplicated");
+  world.InitCounter("rejected");
+  world.InitCounter("applied_once");
+  world.InitCounter("done");
+
+  // For proxies
+  world.SetGlobal<std::string>("config.rsm.pool.name", "rsm");
+
+  // For rsm
+  world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", capacity);
+
+  // For paxos
+  world.SetGlobal<int64_t>("config.paxos.backoff.init", 100);
+  world.SetGlobal<int64_t>("config.paxos.backoff.max", 2000);
+  world.SetGlobal<int64_t>("config.paxos.backoff.factor", 2);
+
+  // Run simulation
+
+  world.Start();
+  while (world.GetCounter("done") < 1 && world.TimeElapsed() < kTimeLimit) {
+    if (!world.Step()) {
+      break;  // Deadlock
+    }
+  }
+
+  // Stop and compute simulation digest
+  size_t digest = world.Stop();
+
+  // Print report
+  runner.Verbose() << "Seed " << seed << " -> "
+  << "digest: " << digest << ", time: " << world.TimeElapsed()
+  << ", steps: " << world.StepCount() << std::endl;
+
+  const auto event_log = world.EventLog();
+
+  if (world.GetCounter("done") < 1) {
+    // Log
+    runner.Report() << "Log:" << std::endl;
+    matrix::WriteTextLog(event_log, runner.Report());
+    runner.Report() << std::endl;
+
+    runner.Report() << "Simulation for seed = " << seed << " failed: ";
+
+    if (world.TimeElapsed() < kTimeLimit) {
+      runner.Report() << "deadlock in simulation" << std::endl;
+    } else {
+      runner.Report() << "time limit exceeded" << std::endl;
+    }
+    runner.Fail();
+  }
+
+  // Check session guarantees
+  if (world.GetCounter("deduplicated") != 1) {
+    runner.Report() << "Retry of live session applied twice for seed = "
+                    << seed << std::endl;
+    runner.Fail();
+  }
+  if (world.GetCounter("rejected") != 1) {
+    runner.Report() << "Retry of evicted session not rejected for seed = "
+                    << seed << std::endl;
+    runner.Fail();
+  }
+  if (world.GetCounter("applied_once") != 1) {
+    runner.Report() << "Retry of evicted session applied twice for seed = "
+                    << seed << std::endl;
+    runner.Fail();
+  }
+
+  return digest;
+}
+
+int main(int argc, const char** argv) {
+  return matrix::Main(argc, argv, RunSimulation);
+}
@@ -2,11 +2,16 @@
 #include <kv/state_machine.hpp>
 
 #include <rsm/replica/main.hpp>
+#include <rsm/proxy/main.hpp>
 
 namespace kv {
 
 void ReplicaMain() {
-  rsm::ReplicaMain(MakeStateMachine());
+  rsm::ReplicaMain(&MakeStateMachine);
+}
+
+void ProxyMain() {
+  rsm::ProxyMain(&MakeStateMachine);
 }
 
 }  // namespace kv
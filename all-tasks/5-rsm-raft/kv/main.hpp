@@ -4,4 +4,7 @@ namespace kv {
 
 void ReplicaMain();
 
+// Proxy routes commands to raft groups by kv keys
+void ProxyMain();
+
 }  // namespace kv
@@ -41,6 +41,17 @@ class StateMachine : public rsm::IStateMachine {
     store_.Install(entries);
   }
 
+  std::string ShardKey(const rsm::Command& cmd) override {
+    if (cmd.type == "Set") {
+      return KeyOf<Set>(cmd);
+    } else if (cmd.type == "Get") {
+      return KeyOf<Get>(cmd);
+    } else if (cmd.type == "Cas") {
+      return KeyOf<Cas>(cmd);
+    }
+    WHEELS_PANIC("Unknown command type: " << cmd.type);
+  }
+
  private:
   Set::Response ApplyImpl(Set::Request set) {
     store_.Set(set.key, set.value);
@@ -62,6 +73,11 @@ class StateMachine : public rsm::IStateMachine {
     return muesli::Serialize(response);
   }
 
+  template <typename Op>
+  static std::string KeyOf(const rsm::Command& cmd) {
+    return muesli::Deserialize<typename Op::Request>(cmd.request).key;
+  }
+
  private:
   Store store_;
 };
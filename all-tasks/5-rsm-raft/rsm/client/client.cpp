@@ -21,9 +21,42 @@ Client::Client(commute::rpc::IChannelPtr proxies)
 
 muesli::Bytes Client::Execute(std::string type, muesli::Bytes request,
                               bool readonly) {
+  if (!session_opened_) {
+    Send(kOpenSession, {}, /*readonly=*/false);
+    session_opened_ = true;
+  }
+  return Send(std::move(type), std::move(request), readonly);
+}
+
+namespace {
+
+// Completes request on any exit, failed calls included, so that
+// AckedIndex keeps advancing
+class InFlightGuard {
+ public:
+  InFlightGuard(std::set<uint64_t>& in_flight, uint64_t index)
+      : in_flight_(in_flight), index_(index) {
+    in_flight_.insert(index_);
+  }
+
+  ~InFlightGuard() {
+    in_flight_.erase(index_);
+  }
+
+ private:
+  std::set<uint64_t>& in_flight_;
+  uint64_t index_;
+};
+
+}  // namespace
+
+muesli::Bytes Client::Send(std::string type, muesli::Bytes request,
+                           bool readonly) {
   auto request_id = NextRequestId();
+  InFlightGuard in_flight_guard{in_flight_, request_id.index};
 
-  Command cmd{std::move(type), std::move(request), request_id, readonly};
+  Command cmd{std::move(type), std::move(request), request_id, readonly,
+              AckedIndex()};
 
   auto f = commute::rpc::Call("RSM-Proxy.Execute")
                .Args(cmd)
@@ -31,9 +64,13 @@ muesli::Bytes Client::Execute(std::string type, muesli::Bytes request,
                .TraceWith(MakeTraceId(cmd))
                .AtLeastOnce()
                .Start()
-               .As<muesli::Bytes>();
+               .As<proto::Response>();
 
-  return await::fibers::Await(std::move(f)).ValueOrThrow();
+  auto response = await::fibers::Await(std::move(f)).ValueOrThrow();
+  if (std::holds_alternative<proto::SessionExpired>(response)) {
+    throw SessionExpiredError(client_id_);
+  }
+  return std::get<proto::Ack>(response).response;
 }
 
 void Client::GenerateClientId() {
@@ -48,4 +85,11 @@ RequestId Client::NextRequestId() {
   return {client_id_, ++request_index_};
 }
 
+uint64_t Client::AckedIndex() const {
+  if (in_flight_.empty()) {
+    return request_index_;
+  }
+  return *in_flight_.begin() - 1;
+}
+
 }  // namespace rsm
\ No newline at end of file
@@ -9,22 +9,44 @@
 #include <commute/rpc/client.hpp>
 #include <commute/rpc/errors.hpp>
 
+#include <algorithm>
+
 using namespace whirl;
 
 namespace rsm {
 
-ProxyClient::ProxyClient(const std::string& rsm_pool_name)
-    : logger_("RSM-Proxy-Client", node::rt::LoggerBackend()) {
+ProxyClient::ProxyClient(const std::string& rsm_pool_name,
+                         IStateMachinePtr router)
+    : router_(std::move(router)),
+      groups_(node::rt::Config()->GetInt<size_t>("raft.groups")),
+      logger_("RSM-Proxy-Client", node::rt::LoggerBackend()) {
   ConnectToRSM(rsm_pool_name);
 }
 
-muesli::Bytes ProxyClient::Execute(const Command& command) {
+proto::Response ProxyClient::Execute(const Command& command) {
+  if (command.type != kOpenSession) {
+    return ExecuteInGroup(command, GroupOf(*router_, command, groups_));
+  }
+  // Sessions are kept per Raft group
+  proto::Response response;
+  for (size_t group = 0; group < groups_; ++group) {
+    Command open = command;
+    open.request = muesli::Serialize(OpenSessionRequest{group});
+    response = ExecuteInGroup(open, group);
+  }
+  return response;
+}
+
+proto::Response ProxyClient::ExecuteInGroup(const Command& command,
+                                            size_t group) {
   size_t attempt = 0;
+  // Backoff cap for overloaded leader, doubled on each rejection
+  uint64_t backoff = kMinBackoff;
 
   while (true) {
     ++attempt;
 
-    std::string target_replica = ChooseReplica(command);
+    std::string target_replica = ChooseReplica(group);
 
     LOG_INFO("Send command {} to {} (attempt {})", command.type, target_replica,
              attempt);
@@ -45,7 +67,7 @@ muesli::Bytes ProxyClient::Execute(const Command& command) {
       std::error_code error = result.GetError().GetErrorCode();
 
       if (IsRetriable(error)) {
-        ForgetLeader();
+        ForgetLeader(group);
         continue;  // Retry on transport errors
       } else {
         WHEELS_PANIC("Internal error, command "
@@ -57,43 +79,57 @@ muesli::Bytes ProxyClient::Execute(const Command& command) {
 
     if (rsm_response.index() == 0) {
       // Ack
-      proto::Ack ack = std::get<0>(rsm_response);
-      return ack.response;
+      return rsm_response;
     } else if (rsm_response.index() == 1) {
       // Redirect to leader
       proto::RedirectToLeader redirect = std::get<1>(rsm_response);
-      CacheLeader(redirect.host);
+      CacheLeader(group, redirect.host);
       LOG_INFO("Command {} redirected to server {}", command.type,
                redirect.host);
       continue;
     } else if (rsm_response.index() == 2) {
       // Not a leader
       LOG_INFO("{} is not a leader, switch to next replica", target_replica);
-      ForgetLeader();
+      ForgetLeader(group);
       node::rt::SleepFor(50_jfs);
       continue;
+    } else if (rsm_response.index() == 3) {
+      // Overloaded
+      proto::Overloaded overloaded = std::get<3>(rsm_response);
+      // Full jitter spreads retries of rejected clients
+      Jiffies delay{overloaded.retry_after + node::rt::RandomNumber(backoff)};
+      LOG_INFO("{} is overloaded, retry command {} in {}", target_replica,
+               command.type, delay);
+      backoff = std::min(backoff * 2, kMaxBackoff);
+      node::rt::SleepFor(delay);
+      continue;
+    } else if (rsm_response.index() == 4) {
+      // Session expired, surfaced by client
+      LOG_INFO("Session of client {} expired",
+               std::get<4>(rsm_response).client_id);
+      return rsm_response;
     }
   }
 }
 
-void ProxyClient::CacheLeader(const std::string& host) {
+void ProxyClient::CacheLeader(size_t group, const std::string& host) {
   auto lock = mutex_.Guard();
-  leader_.emplace(host);
+  leaders_[group] = host;
 }
 
-void ProxyClient::ForgetLeader() {
+void ProxyClient::ForgetLeader(size_t group) {
   auto lock = mutex_.Guard();
-  leader_.reset();
+  leaders_.erase(group);
 }
 
 std::string ProxyClient::PickRandomReplica() {
   return replicas_[node::rt::RandomIndex(replicas_.size())];
 }
 
-std::string ProxyClient::ChooseReplica(const Command& /*cmd*/) {
+std::string ProxyClient::ChooseReplica(size_t group) {
   auto lock = mutex_.Guard();
-  if (leader_.has_value()) {
-    return *leader_;
+  if (auto it = leaders_.find(group); it != leaders_.end()) {
+    return it->second;
   }
   return PickRandomReplica();
 }
@@ -3,6 +3,8 @@
 #include <timber/log.hpp>
 
 #include <rsm/client/command.hpp>
+#include <rsm/replica/proto/response.hpp>
+#include <rsm/replica/state_machine.hpp>
 
 #include <muesli/serialize.hpp>
 
@@ -11,35 +13,46 @@
 #include <await/fibers/sync/mutex.hpp>
 
 #include <map>
-#include <optional>
 #include <vector>
 
 namespace rsm {
 
 class ProxyClient {
  public:
-  explicit ProxyClient(const std::string& rsm_pool_name);
+  ProxyClient(const std::string& rsm_pool_name, IStateMachinePtr router);
 
-  muesli::Bytes Execute(const Command& cmd);
+  // Ack or SessionExpired
+  proto::Response Execute(const Command& cmd);
 
  private:
+  proto::Response ExecuteInGroup(const Command& cmd, size_t group);
+
   void ConnectToRSM(const std::string& pool_name);
   commute::rpc::IChannelPtr Channel(const std::string& host);
 
   static bool IsRetriable(const std::error_code& error);
 
-  void CacheLeader(const std::string& host);
-  void ForgetLeader();
+  void CacheLeader(size_t group, const std::string& host);
+  void ForgetLeader(size_t group);
   std::string PickRandomReplica();
 
-  std::string ChooseReplica(const Command& cmd);
+  std::string ChooseReplica(size_t group);
 
  private:
+  // Jiffies
+  static constexpr uint64_t kMinBackoff = 10;
+  static constexpr uint64_t kMaxBackoff = 1000;
+
   std::vector<std::string> replicas_;
   std::map<std::string, commute::rpc::IChannelPtr> channels_;
 
-  await::fibers::Mutex mutex_;  // Guards leader_
-  std::optional<std::string> leader_;
+  // Only ShardKey is called
+  IStateMachinePtr router_;
+  const size_t groups_;
+
+  await::fibers::Mutex mutex_;  // Guards leaders_
+  // Raft group -> leader, groups are led by different replicas
+  std::map<size_t, std::string> leaders_;
 
   timber::Logger logger_;
 };
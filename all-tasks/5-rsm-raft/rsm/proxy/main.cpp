@@ -15,15 +15,15 @@ std::string RsmPoolName() {
   return node::rt::Config()->GetString("rsm.pool.name");
 }
 
-commute::rpc::IServicePtr MakeProxyService() {
-  return std::make_shared<ProxyService>(RsmPoolName());
+commute::rpc::IServicePtr MakeProxyService(StateMachineFactory router) {
+  return std::make_shared<ProxyService>(RsmPoolName(), router());
 }
 
-void ProxyMain() {
+void ProxyMain(StateMachineFactory router) {
   auto rpc_server = node::rpc::MakeServer(  //
       node::rt::Config()->GetInt<uint16_t>("rpc.port"));
 
-  rpc_server->RegisterService("RSM-Proxy", MakeProxyService());
+  rpc_server->RegisterService("RSM-Proxy", MakeProxyService(router));
   rpc_server->Start();
 
   await::futures::BlockForever();
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <rsm/replica/state_machine.hpp>
+
 namespace rsm {
 
 // Main routine for RSM proxy
-void ProxyMain();
+// State machine routes commands to raft groups, see IStateMachine::ShardKey
+void ProxyMain(StateMachineFactory router);
 
 }  // namespace rsm
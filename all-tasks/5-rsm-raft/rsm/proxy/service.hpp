@@ -8,11 +8,11 @@ namespace rsm {
 
 class ProxyService : public commute::rpc::ServiceBase<ProxyService> {
  public:
-  explicit ProxyService(const std::string& rsm_pool_name)
-      : client_(rsm_pool_name) {
+  ProxyService(const std::string& rsm_pool_name, IStateMachinePtr router)
+      : client_(rsm_pool_name, std::move(router)) {
   }
 
-  muesli::Bytes Execute(Command command) {
+  proto::Response Execute(Command command) {
     // Forward request to rsm replica
     return client_.Execute(std::move(command));
   }
@@ -12,14 +12,14 @@ using namespace whirl;
 
 namespace rsm {
 
-void ReplicaMain(IStateMachinePtr state_machine) {
+void ReplicaMain(StateMachineFactory state_machines) {
   node::rt::Database()->Open(node::rt::Config()->GetString("db.path"));
 
   auto rpc_server = whirl::node::rpc::MakeServer(
       node::rt::Config()->GetInt<uint16_t>("rpc.port"));
 
   auto replica =
-      rsm::MakeRaftReplica(std::move(state_machine), rpc_server.get());
+      rsm::MakeRaftReplica(std::move(state_machines), rpc_server.get());
 
   auto service = std::make_shared<rsm::ReplicaService>(replica);
 
@@ -5,6 +5,6 @@
 namespace rsm {
 
 // Main routine for RSM replica
-void ReplicaMain(IStateMachinePtr state_machine);
+void ReplicaMain(StateMachineFactory state_machines);
 
 }  // namespace rsm
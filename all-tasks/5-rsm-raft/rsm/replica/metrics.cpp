@@ -0,0 +1,87 @@
+#include <rsm/replica/metrics.hpp>
+
+#include <algorithm>
+
+namespace rsm {
+
+//////////////////////////////////////////////////////////////////////
+
+static size_t BitWidth(uint64_t value) {
+  size_t width = 0;
+  while (value > 0) {
+    value >>= 1;
+    ++width;
+  }
+  return width;
+}
+
+void Histogram::Add(uint64_t value) {
+  size_t bucket = BitWidth(value);
+  if (buckets.size() <= bucket) {
+    buckets.resize(bucket + 1, 0);
+  }
+  ++buckets[bucket];
+  ++count;
+  sum += value;
+  max = std::max(max, value);
+}
+
+uint64_t Histogram::Quantile(double q) const {
+  uint64_t rank = q * count;
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+    seen += buckets[bucket];
+    if (seen > rank) {
+      return std::min(max, (uint64_t{1} << bucket) - 1);
+    }
+  }
+  return max;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& out, const Histogram& histogram) {
+  out << "{count: " << histogram.count;
+  if (histogram.count > 0) {
+    out << ", avg: " << histogram.sum / histogram.count
+        << ", p50: " << histogram.Quantile(0.5)
+        << ", p99: " << histogram.Quantile(0.99)
+        << ", max: " << histogram.max;
+  }
+  out << "}";
+  return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const RaftMetrics& metrics) {
+  out << metrics.state << " term: " << metrics.term
+      << ", log: " << metrics.log_length
+      << ", commit: " << metrics.commit_index
+      << ", applied: " << metrics.last_applied
+      << ", sessions: " << metrics.sessions
+      << ", rtt: " << metrics.rtt
+      << ", election timeout: " << metrics.election_timeout
+      << ", pre-votes: " << metrics.pre_votes_started
+      << ", elections: " << metrics.elections_started
+      << ", term changes: " << metrics.term_changes
+      << ", leaderships: " << metrics.leaderships
+      << ", step downs: " << metrics.step_downs
+      << ", overloaded: " << metrics.overloaded
+      << ", AE during log write: " << metrics.appends_during_log_write
+      << ", batch size: " << metrics.batch_size
+      << ", commit to apply: " << metrics.commit_to_apply;
+  for (const auto& [peer, peer_metrics] : metrics.peers) {
+    out << "; " << peer << " next: " << peer_metrics.next_index
+        << ", match: " << peer_metrics.match_index
+        << ", lag: " << peer_metrics.lag
+        << ", in flight: " << peer_metrics.in_flight
+        << ", rtt estimate: " << peer_metrics.rtt_estimate
+        << ", AE sent: " << peer_metrics.append_entries_sent
+        << ", rejected: " << peer_metrics.append_entries_rejected
+        << ", failed: " << peer_metrics.append_entries_failed
+        << ", snapshots: " << peer_metrics.snapshots_sent
+        << ", AE rtt: " << peer_metrics.append_entries_rtt;
+  }
+  return out;
+}
+
+}  // namespace rsm
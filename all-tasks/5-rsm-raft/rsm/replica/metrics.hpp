@@ -0,0 +1,119 @@
+#pragma once
+
+#include <muesli/serializable.hpp>
+
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace rsm {
+
+//////////////////////////////////////////////////////////////////////
+
+// Power-of-two buckets, cheap enough to update on every event
+
+struct Histogram {
+  // buckets[i] counts values of bit width i: 2^(i-1) <= value < 2^i
+  std::vector<uint64_t> buckets;
+  uint64_t count{0};
+  uint64_t sum{0};
+  uint64_t max{0};
+
+  void Add(uint64_t value);
+
+  // Upper bound of the bucket containing quantile q in [0, 1]
+  uint64_t Quantile(double q) const;
+
+  MUESLI_SERIALIZABLE(buckets, count, sum, max)
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Replication to single peer, meaningful on leader
+
+struct PeerMetrics {
+  // Gauges, filled on read
+  uint64_t next_index{0};
+  uint64_t match_index{0};
+  // Leader log length - match index
+  uint64_t lag{0};
+  uint64_t in_flight{0};
+  // Smoothed RTT plus jitter margin, jiffies
+  uint64_t rtt_estimate{0};
+
+  // Counters
+  uint64_t append_entries_sent{0};
+  uint64_t append_entries_rejected{0};
+  uint64_t append_entries_failed{0};
+  uint64_t snapshots_sent{0};
+
+  // Jiffies
+  Histogram append_entries_rtt;
+
+  MUESLI_SERIALIZABLE(next_index, match_index, lag, in_flight, rtt_estimate,
+                      append_entries_sent, append_entries_rejected,
+                      append_entries_failed, snapshots_sent,
+                      append_entries_rtt)
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Snapshot of replica metrics
+// Counters live since replica start, gauges are filled on read
+
+struct RaftMetrics {
+  // Gauges
+  std::string state;
+  uint64_t term{0};
+  uint64_t log_length{0};
+  uint64_t commit_index{0};
+  uint64_t last_applied{0};
+  // Client sessions retained for exactly-once semantics
+  uint64_t sessions{0};
+  // Bounded RTT estimate timeouts are derived from and current election
+  // timeout, jiffies
+  uint64_t rtt{0};
+  uint64_t election_timeout{0};
+
+  // Elections
+  uint64_t pre_votes_started{0};
+  uint64_t elections_started{0};
+  uint64_t term_changes{0};
+  uint64_t leaderships{0};
+  uint64_t step_downs{0};
+
+  // Commands rejected by admission control
+  uint64_t overloaded{0};
+
+  // AppendEntries sent while leader log write is in progress
+  uint64_t appends_during_log_write{0};
+
+  // Entries per leader log write
+  Histogram batch_size;
+  // Jiffies from commit index advance to apply
+  Histogram commit_to_apply;
+
+  std::map<std::string, PeerMetrics> peers;
+
+  // See raft::proto::Metrics
+  bool unknown_group{false};
+
+  MUESLI_SERIALIZABLE(state, term, log_length, commit_index, last_applied,
+                      sessions, rtt, election_timeout, pre_votes_started,
+                      elections_started, term_changes, leaderships,
+                      step_downs, overloaded, appends_during_log_write,
+                      batch_size, commit_to_apply, peers, unknown_group)
+};
+
+//////////////////////////////////////////////////////////////////////
+
+std::ostream& operator<<(std::ostream& out, const Histogram& histogram);
+std::ostream& operator<<(std::ostream& out, const RaftMetrics& metrics);
+
+}  // namespace rsm
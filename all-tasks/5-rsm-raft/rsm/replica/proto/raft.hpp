@@ -2,14 +2,23 @@
 
 #include <rsm/replica/store/log_entry.hpp>
 
+#include <muesli/bytes.hpp>
+
 #include <muesli/serializable.hpp>
 
+#include <cereal/types/vector.hpp>
+
 #include <cstdlib>
+#include <vector>
 
 namespace rsm {
 
 namespace raft::proto {
 
+// Every request carries its Raft group, see RaftGroups
+// Request for unknown group gets response with unknown_group set,
+// callers treat it as failed RPC
+
 //////////////////////////////////////////////////////////////////////
 
 // Leader election
@@ -20,15 +29,22 @@ struct RequestVote {
     std::string candidate;
     uint64_t last_log_index;
     uint64_t last_log_term;
-
-    MUESLI_SERIALIZABLE(term, candidate, last_log_index, last_log_term)
+    // Probe for the election in term, voter state is not changed
+    bool pre_vote{false};
+    // Election requested by leader via TimeoutNow
+    bool transfer{false};
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(term, candidate, last_log_index, last_log_term,
+                        pre_vote, transfer, group)
   };
 
   struct Response {
-    uint64_t term;
-    bool vote_granted;
+    uint64_t term{0};
+    bool vote_granted{false};
+    bool unknown_group{false};
 
-    MUESLI_SERIALIZABLE(term, vote_granted)
+    MUESLI_SERIALIZABLE(term, vote_granted, unknown_group)
   };
 };
 
@@ -42,20 +58,170 @@ struct AppendEntries {
     std::string leader;
     uint64_t prev_log_index;
     uint64_t prev_log_term;
-    LogEntries entries;
+    // Carried as stored in leader log
+    RawLogEntries entries;
     uint64_t leader_commit_index;
+    uint64_t group{0};
+    // Leader estimate of RTT to receiver, 0 if not measured yet
+    uint64_t link_rtt{0};
 
     MUESLI_SERIALIZABLE(term, leader, prev_log_index, prev_log_term, entries,
-                        leader_commit_index)
+                        leader_commit_index, group, link_rtt)
   };
 
   struct Response {
-    uint64_t term;
-    bool success;
+    uint64_t term{0};
+    bool success{false};
     uint64_t conflict_index{1};
     uint64_t conflict_term{0};
+    // Follower entries not applied yet, leader slows down on large backlog
+    uint64_t backlog{0};
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(term, success, conflict_index, conflict_term, backlog,
+                        unknown_group)
+  };
+};
+
+// AppendEntries of all groups to the same peer in one message,
+// see RaftGroups
+
+struct AppendBatch {
+  struct Request {
+    std::vector<AppendEntries::Request> appends;
+
+    MUESLI_SERIALIZABLE(appends)
+  };
+
+  struct Response {
+    // Same order as appends
+    std::vector<AppendEntries::Response> acks;
+
+    MUESLI_SERIALIZABLE(acks)
+  };
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Compaction
+
+struct InstallSnapshot {
+  struct Request {
+    uint64_t term;
+    std::string leader;
+    uint64_t last_included_index;
+    uint64_t last_included_term;
+    // Chunk of serialized rsm::Snapshot, see raft.snapshot.chunk
+    uint64_t offset{0};
+    muesli::Bytes data;
+    // Last chunk
+    bool done{false};
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(term, leader, last_included_index, last_included_term,
+                        offset, data, done, group)
+  };
+
+  struct Response {
+    uint64_t term{0};
+    // Bytes of snapshot received so far, leader restarts transfer
+    // if chunk was not accepted
+    uint64_t received{0};
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(term, received, unknown_group)
+  };
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Leadership transfer
+
+struct TransferLeadership {
+  struct Request {
+    // Empty target: most up-to-date follower
+    std::string target;
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(target, group)
+  };
+
+  struct Response {
+    // Empty if this node is not a leader or target is unknown
+    std::string target;
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(target, unknown_group)
+  };
+};
+
+struct TimeoutNow {
+  struct Request {
+    uint64_t term;
+    std::string leader;
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(term, leader, group)
+  };
+
+  struct Response {
+    uint64_t term{0};
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(term, unknown_group)
+  };
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Learners
+
+// Leader appends membership change, learner votes once it is appended
+struct PromoteLearner {
+  struct Request {
+    std::string learner;
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(learner, group)
+  };
+
+  struct Response {
+    // False if this node is not a leader, learner is unknown or lags
+    // behind, or previous membership change is not committed yet
+    bool accepted{false};
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(accepted, unknown_group)
+  };
+};
+
+// Follower reads: leader confirms its leadership with a heartbeat round
+// and returns commit index, follower serves read once it applies it
+struct ReadIndex {
+  struct Request {
+    uint64_t group{0};
+
+    MUESLI_SERIALIZABLE(group)
+  };
+
+  struct Response {
+    bool ok{false};
+    uint64_t read_index{0};
+    bool unknown_group{false};
+
+    MUESLI_SERIALIZABLE(ok, read_index, unknown_group)
+  };
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Observability, responds with RaftMetrics
+
+struct Metrics {
+  struct Request {
+    uint64_t group{0};
 
-    MUESLI_SERIALIZABLE(term, success, conflict_index, conflict_term)
+    MUESLI_SERIALIZABLE(group)
   };
 };
 
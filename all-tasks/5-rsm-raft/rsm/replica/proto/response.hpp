@@ -39,7 +39,28 @@ using NotALeader = muesli::EmptyMessage;
 
 //////////////////////////////////////////////////////////////////////
 
-using Response = std::variant<Ack, RedirectToLeader, NotALeader>;
+// Leader rejected command by admission control, retry later
+struct Overloaded {
+  // Hint for client backoff, jiffies
+  uint64_t retry_after;
+
+  MUESLI_SERIALIZABLE(retry_after);
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Client session was evicted, see SessionTable
+// Command is rejected instead of being applied twice
+struct SessionExpired {
+  std::string client_id;
+
+  MUESLI_SERIALIZABLE(client_id);
+};
+
+//////////////////////////////////////////////////////////////////////
+
+using Response =
+    std::variant<Ack, RedirectToLeader, NotALeader, Overloaded, SessionExpired>;
 
 }  // namespace proto
 
@@ -1,7 +1,12 @@
 #include <rsm/replica/raft.hpp>
 
+#include <rsm/replica/metrics.hpp>
 #include <rsm/replica/proto/raft.hpp>
+#include <rsm/replica/rtt_estimator.hpp>
+#include <rsm/replica/sessions.hpp>
+#include <rsm/replica/store/hard_state.hpp>
 #include <rsm/replica/store/log.hpp>
+#include <rsm/replica/store/snapshot.hpp>
 #include <whirl/node/store/struct.hpp>
 
 #include <commute/rpc/call.hpp>
@@ -10,16 +15,25 @@
 #include <await/fibers/core/api.hpp>
 #include <await/fibers/sync/channel.hpp>
 #include <await/fibers/sync/mutex.hpp>
-#include <await/fibers/sync/select.hpp>
+
+#include <muesli/serialize.hpp>
 
 #include <timber/log.hpp>
 
+#include <wheels/support/panic.hpp>
+
 #include <whirl/node/runtime/shortcuts.hpp>
 #include <whirl/node/cluster/peer.hpp>
 
 #include <mutex>
+#include <map>
 #include <optional>
+#include <set>
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
 
 using await::futures::Future;
 using await::futures::Promise;
@@ -28,33 +42,93 @@ using namespace whirl;
 
 namespace rsm {
 
+// Command type of membership change, never applied to state machine
+static const std::string kPromoteLearner = "Raft.PromoteLearner";
+
 enum class NodeState {
   Candidate = 1,  // Do not format
   Follower = 2,
   Leader = 3
 };
 
+// Single Raft group, hosted by RaftGroups
+
 class Raft : public IReplica,
-             public commute::rpc::ServiceBase<Raft>,
              public node::cluster::Peer,
              public std::enable_shared_from_this<Raft> {
  public:
-  Raft(IStateMachinePtr state_machine, persist::fs::Path store_dir)
+  // AppendEntries with everything needed to handle its reply
+  struct OutgoingAppend {
+    raft::proto::AppendEntries::Request request;
+    uint64_t epoch;
+    // ReadIndex round confirmed by reply
+    size_t round;
+    node::time::MonotonicTime sent_at;
+  };
+
+  // Delivers AppendEntries to peer, reply is passed back to
+  // HandleAppendEntriesReply, see RaftGroups
+  using AppendSender =
+      std::function<void(const std::string& peer, OutgoingAppend append)>;
+
+ public:
+  Raft(size_t group, size_t group_count, IStateMachinePtr state_machine,
+       persist::fs::Path store_dir, AppendSender send_append)
       : Peer(node::rt::Config()),
+        group_(group),
+        group_count_(group_count),
+        send_append_(std::move(send_append)),
         state_machine_(std::move(state_machine)),
         log_(node::rt::Fs(), store_dir),
-        storage_(node::rt::Database(), "Persist"),
-        logger_("Raft", node::rt::LoggerBackend()) {
+        storage_(node::rt::Database(), "Persist-" + std::to_string(group)),
+        logger_("Raft-" + std::to_string(group), node::rt::LoggerBackend()) {
+    replication_window_ =
+        node::rt::Config()->GetInt<size_t>("raft.replication.window");
+    lease_reads_ = node::rt::Config()->GetInt<int>("raft.read.lease") != 0;
+    apply_batch_size_ =
+        node::rt::Config()->GetInt<size_t>("raft.apply.batch_size");
+    snapshot_threshold_ =
+        node::rt::Config()->GetInt<size_t>("raft.snapshot.threshold");
+    snapshot_chunk_size_ = std::max<size_t>(
+        node::rt::Config()->GetInt<size_t>("raft.snapshot.chunk"), 1);
+    batch_delay_ =
+        Jiffies{node::rt::Config()->GetInt<uint64_t>("raft.batch.delay")};
+    batch_max_entries_ =
+        node::rt::Config()->GetInt<size_t>("raft.batch.max_entries");
+    batch_max_bytes_ =
+        node::rt::Config()->GetInt<size_t>("raft.batch.max_bytes");
+    append_max_entries_ =
+        node::rt::Config()->GetInt<size_t>("raft.append.max_entries");
+    append_max_bytes_ =
+        node::rt::Config()->GetInt<size_t>("raft.append.max_bytes");
+    follower_reads_ =
+        node::rt::Config()->GetInt<int>("raft.read.followers") != 0;
+    sessions_capacity_ =
+        node::rt::Config()->GetInt<size_t>("rsm.sessions.capacity");
+    admission_max_entries_ =
+        node::rt::Config()->GetInt<size_t>("raft.admission.max_entries");
+    admission_max_bytes_ =
+        node::rt::Config()->GetInt<size_t>("raft.admission.max_bytes");
+    admission_max_per_client_ =
+        node::rt::Config()->GetInt<size_t>("raft.admission.max_per_client");
+    rtt_min_percent_ =
+        node::rt::Config()->GetInt<uint64_t>("raft.rtt.min_percent");
+    rtt_max_percent_ =
+        node::rt::Config()->GetInt<uint64_t>("raft.rtt.max_percent");
   }
 
   Future<proto::Response> Execute(Command command) override {
     std::unique_lock guard(mutex_);
     auto [future, promise] = await::futures::MakeContract<proto::Response>();
-    if (cache_.find(command.request_id) != cache_.end()) {
-      std::move(promise).SetValue(proto::Ack{cache_[command.request_id]});
+    if (auto response = FindSession(command.request_id)) {
+      std::move(promise).SetValue(proto::Ack{std::move(*response)});
       return std::move(future);
     }
     if (state_ != NodeState::Leader) {
+      if (command.readonly && follower_reads_ && leader_.has_value()) {
+        ServeFollowerRead(std::move(command), std::move(promise));
+        return std::move(future);
+      }
       // TODO: maybe only if follower
       if (leader_.has_value()) {
         std::move(promise).SetValue(proto::RedirectToLeader{leader_.value()});
@@ -63,68 +137,115 @@ class Raft : public IReplica,
       }
       return std::move(future);
     }
-    std::vector<LogEntry> new_entry{LogEntry{command, term_}};
-
-    log_.Append(new_entry);
-    LOG_INFO("Appended {} at term {}.", command, term_);
-    PersistToStorage();
-    trigger_ae_channel_.TrySend(1);
+    if (transfer_target_.has_value()) {
+      // Leadership is handed off, client retries after election
+      std::move(promise).SetValue(proto::NotALeader{});
+      return std::move(future);
+    }
+    if (command.readonly && HoldsLease()) {
+      // Commit index is up to date, no need to confirm leadership
+      LOG_INFO("Serving read {} under lease", command);
+      pending_reads_.push_back(
+          {std::move(command), commit_index_, /*round=*/0, std::move(promise)});
+      WakeApplier();
+      return std::move(future);
+    }
+    if (command.readonly && log_.Term(commit_index_) == term_) {
+      // ReadIndex: commit index is up to date once leader has committed
+      // an entry from its term, otherwise read goes through the log
+      pending_reads_.push_back(
+          {std::move(command), commit_index_, ++read_round_,
+           std::move(promise)});
+      WakeReplicators(/*heartbeat=*/true);
+      WakeApplier();
+      return std::move(future);
+    }
+    if (!Admit(command)) {
+      ++metrics_.overloaded;
+      std::move(promise).SetValue(proto::Overloaded{HeartbeatInterval()});
+      return std::move(future);
+    }
     WHEELS_ASSERT(
         commit_channels_.find(command.request_id) == commit_channels_.end(),
         "Command already in commit_channels_");
     commit_channels_.emplace(command.request_id, std::move(promise));
 
+    batch_bytes_ += command.request.size();
+    batch_.push_back(LogEntry{std::move(command), term_});
+    if (batch_.size() >= batch_max_entries_ ||
+        batch_bytes_ >= batch_max_bytes_) {
+      FlushBatch();
+    } else if (batch_.size() == 1) {
+      await::fibers::Go([&, batch_id = batch_id_, self{shared_from_this()}]() {
+        node::rt::SleepFor(batch_delay_);
+        std::lock_guard guard{mutex_};
+        if (batch_id_ == batch_id) {
+          FlushBatch();
+        }
+      });
+    }
+
     return std::move(future);
   };
 
-  void Start(commute::rpc::IServer* /*rpc_server*/) {
+  void Start() {
     std::unique_lock lock{mutex_};
     LOG_INFO("Starting...");
+    preferred_leader_ = IsPreferredLeader();
+    learners_ = InitialLearners();
     state_machine_->Reset();
-    log_.Open();
-    auto st_voted_for = storage_.TryLoad<std::string>("votedFor");
-    if (st_voted_for.has_value()) {
-      voted_for_ = st_voted_for.value();
-      persisted_voted_for_ = st_voted_for.value();
-    }
-    auto st_term = storage_.TryLoad<size_t>("currentTerm");
-    if (st_term.has_value()) {
-      term_ = st_term.value();
-      persisted_term_ = term_;
+    auto snapshot = storage_.TryLoad<Snapshot>("snapshot");
+    if (snapshot.has_value()) {
+      state_machine_->InstallSnapshot(snapshot->state);
+      std::lock_guard apply_guard{apply_mutex_};
+      sessions_ = std::move(snapshot->sessions);
+      promotions_ = std::move(snapshot->promotions);
+      log_.Open(snapshot->log_base);
+    } else {
+      log_.Open();
     }
-    auto st_commit_index = storage_.TryLoad<size_t>("commitIndex");
-    if (st_commit_index.has_value()) {
-      commit_index_ = st_commit_index.value();
-      persisted_commit_index_ = commit_index_;
+    last_applied_ = log_.Base().index;
+    for (size_t index = last_applied_ + 1; index <= log_.Length(); ++index) {
+      NoteMembershipChange(index, log_.Read(index));
     }
-    LOG_INFO("Filling cache, commit index {} log length {}", commit_index_,
-             log_.Length());
-    for (size_t i = 1; i <= commit_index_; ++i) {
-      auto entry = log_.Read(i);
-      if (cache_.find(entry.command.request_id) == cache_.end()) {
-        auto response = state_machine_->Apply(entry.command);
-        cache_[entry.command.request_id] = response;
+    auto hard_state = storage_.TryLoad<HardState>("hardState");
+    if (hard_state.has_value()) {
+      term_ = hard_state->term;
+      if (!hard_state->voted_for.empty()) {
+        voted_for_ = hard_state->voted_for;
       }
+      persisted_hard_state_ = *hard_state;
     }
+    // Commit index is not persisted, everything up to snapshot is committed
+    commit_index_ = last_applied_;
+    LOG_INFO("Restored snapshot index {} commit index {} log length {}",
+             last_applied_, commit_index_, log_.Length());
 
-    auto cur_term = term_;
+    election_reset_event_ = node::rt::MonotonicNow();
+    election_timeout_ = ElectionTimeout();
+    // Rebooted voter may have renewed lease of live leader right before
+    // crash: deny votes for a full election timeout, as if it had just
+    // heard from the leader, until that lease has expired
+    leader_contact_ = election_reset_event_;
     lock.unlock();
 
-    await::fibers::Go([&, cur_term, self{shared_from_this()}]() {
-      election_reset_event_ = node::rt::MonotonicNow();
-      RunElectionTimer(cur_term);
+    await::fibers::Go([&, self{shared_from_this()}]() {
+      RunApplier();
     });
-    LOG_INFO("Started");
-  }
+    WakeApplier();
 
- protected:
-  // RPC handlers
+    await::fibers::Go([&, self{shared_from_this()}]() {
+      RunLogWriter();
+    });
 
-  void RegisterMethods() override {
-    COMMUTE_RPC_REGISTER_HANDLER(RequestVote);
-    COMMUTE_RPC_REGISTER_HANDLER(AppendEntries);
+    await::fibers::Go([&, self{shared_from_this()}]() {
+      RunElectionTimer();
+    });
+    LOG_INFO("Started");
   }
 
+  // RPC handlers, dispatched by RaftGroups
+
   // Leader election
 
   void RequestVote(const raft::proto::RequestVote::Request& request,
@@ -132,6 +253,22 @@ class Raft : public IReplica,
     std::lock_guard guard(mutex_);
     auto [last_log_index, last_log_term] = LastIndex();
     response->vote_granted = false;
+    if (!request.transfer && LeaderAlive()) {
+      // Partitioned or rebooted node must not depose live leader
+      LOG_INFO("RPC_RV: ignore {}, current leader is alive", request.candidate);
+      response->term = term_;
+      return;
+    }
+    if (request.pre_vote) {
+      // Would we vote in the next term? No state changes
+      response->term = term_;
+      response->vote_granted =
+          request.term > term_ &&
+          LogUpToDate(request, last_log_index, last_log_term);
+      LOG_INFO("RPC_RV: pre-vote for {} {}", request.candidate,
+               response->vote_granted);
+      return;
+    }
     LOG_INFO(
         "RPC_RV: START term={}, candidate={}, index/term=({}, {}) "
         "[currentTerm={}, votedFor={}, log index/term=({}, {})]",
@@ -145,23 +282,31 @@ class Raft : public IReplica,
     }
     if (request.term == term_ &&
         (!voted_for_.has_value() || voted_for_.value() == request.candidate) &&
-        (request.last_log_term > last_log_term ||
-         (request.last_log_term == last_log_term &&
-          request.last_log_index >= last_log_index))) {
+        LogUpToDate(request, last_log_index, last_log_term)) {
       response->vote_granted = true;
       voted_for_ = request.candidate;
       election_reset_event_ = node::rt::MonotonicNow();
     }
     response->term = term_;
-    PersistToStorage();
+    PersistHardState();
     LOG_INFO("RPC_RV: response {} {}", response->term, response->vote_granted);
   }
 
+  static bool LogUpToDate(const raft::proto::RequestVote::Request& request,
+                          size_t last_log_index, size_t last_log_term) {
+    return request.last_log_term > last_log_term ||
+           (request.last_log_term == last_log_term &&
+            request.last_log_index >= last_log_index);
+  }
+
   // Replication
 
   void AppendEntries(const raft::proto::AppendEntries::Request& request,
                      raft::proto::AppendEntries::Response* response) {
     std::lock_guard guard{mutex_};
+    if (request.entries.empty() && HandleHeartbeat(request, response)) {
+      return;
+    }
     LOG_INFO(
         "RPC_AE: START from leader {}, term {}, prev idx/term ({}/{}), "
         "leader_commit {}",
@@ -179,15 +324,27 @@ class Raft : public IReplica,
         BecomeFollower(request.term);
       }
       election_reset_event_ = node::rt::MonotonicNow();
-
-      if (request.prev_log_index == 0 ||
-          (request.prev_log_index <= log_.Length() &&
-           request.prev_log_term == log_.Term(request.prev_log_index))) {
-        // no prev log index or prev log index inside local log + term matches
+      leader_contact_ = election_reset_event_;
+      NoteLinkRtt(request.link_rtt);
+
+      // Entries covered by local snapshot are committed, skip them
+      size_t skip = 0;
+      if (request.prev_log_index < log_.Base().index) {
+        skip = std::min(log_.Base().index - request.prev_log_index,
+                        request.entries.size());
+      }
+      size_t prev_log_index = request.prev_log_index + skip;
+      uint64_t prev_log_term =
+          skip > 0 ? request.entries[skip - 1].term : request.prev_log_term;
+
+      if (prev_log_index < log_.Base().index ||
+          (prev_log_index <= log_.Length() &&
+           prev_log_term == log_.Term(prev_log_index))) {
+        // prev log index inside snapshot or local log + term matches
         response->success = true;
 
-        size_t log_insert_index = request.prev_log_index + 1;
-        size_t new_entries_index = 0;
+        size_t log_insert_index = prev_log_index + 1;
+        size_t new_entries_index = skip;
         while (true) {
           if (log_insert_index > log_.Length() ||
               new_entries_index >= request.entries.size()) {
@@ -204,34 +361,33 @@ class Raft : public IReplica,
         if (new_entries_index < request.entries.size()) {
           if (log_.Length() >= log_insert_index) {
             log_.TruncateSuffix(log_insert_index);
+            // Membership changes take effect on append, undone on truncation
+            promotions_.erase(promotions_.lower_bound(log_insert_index),
+                              promotions_.end());
           }
 
           log_.Append(request.entries, new_entries_index);
+          for (size_t i = new_entries_index; i < request.entries.size(); ++i) {
+            const auto& entry = request.entries[i];
+            if (entry.config) {
+              NoteMembershipChange(log_insert_index + i - new_entries_index,
+                                   muesli::Deserialize<LogEntry>(entry.bytes));
+            }
+          }
         }
 
+        // Entries past the last new one may be stale, do not commit them
         size_t new_commit_index =
-            std::min(request.leader_commit_index, log_.Length());
+            std::min(request.leader_commit_index,
+                     request.prev_log_index + request.entries.size());
         if (new_commit_index > commit_index_) {
-          ++commit_index_;
-          for (; commit_index_ < new_commit_index; ++commit_index_) {
-            auto command = log_.Read(commit_index_).command;
-            if (cache_.find(command.request_id) == cache_.end()) {
-              auto response1 = state_machine_->Apply(command);
-              cache_[command.request_id] = response1;
-            }
-          }
-          // TODO: make prettier
-          {
-            auto command = log_.Read(commit_index_).command;
-            if (cache_.find(command.request_id) == cache_.end()) {
-              auto response1 = state_machine_->Apply(command);
-              cache_[command.request_id] = response1;
-            }
-          }
+          commit_index_ = new_commit_index;
+          NoteCommit();
+          WakeApplier();
         }
       } else {
         LOG_INFO("RPC_AE: Failure");
-        if (request.prev_log_index > log_.Length()) {
+        if (prev_log_index > log_.Length()) {
           // prev log index outside local log
           LOG_INFO("RPC_AE: prev log index outside local log");
           response->conflict_index = log_.Length() + 1;
@@ -239,23 +395,457 @@ class Raft : public IReplica,
         } else {
           // inside local log but term doesn't match
           LOG_INFO("RPC_AE: inside local log but term doesn't match {}",
-                   request.prev_log_index);
-          response->conflict_term = log_.Term(request.prev_log_index);
-          //          response->conflict_index = 1;
-          for (size_t i = request.prev_log_index - 1; i > 0; --i) {
-            if (log_.Term(i) != response->conflict_term) {
-              response->conflict_index = i + 1;
-              break;
-            }
-          }
+                   prev_log_index);
+          response->conflict_term = log_.Term(prev_log_index);
+          response->conflict_index =
+              log_.FirstIndexOfTerm(response->conflict_term);
         }
       }
     }
     response->term = term_;
+    response->backlog = Backlog();
     LOG_INFO("RPC_AE: Final response {} {} {} {}", response->term,
              response->success, response->conflict_index,
              response->conflict_term);
-    PersistToStorage();
+    PersistHardState();
+  }
+
+  // With mutex
+  // Heartbeat from current leader that touches only in-memory state
+  // Returns false if request needs the full AppendEntries path
+  bool HandleHeartbeat(const raft::proto::AppendEntries::Request& request,
+                       raft::proto::AppendEntries::Response* response) {
+    if (request.term != term_ || state_ != NodeState::Follower) {
+      return false;
+    }
+    size_t prev_log_index = request.prev_log_index;
+    if (prev_log_index < log_.Base().index || prev_log_index > log_.Length() ||
+        log_.Term(prev_log_index) != request.prev_log_term) {
+      // Conflict resolution
+      return false;
+    }
+
+    leader_ = request.leader;
+    election_reset_event_ = node::rt::MonotonicNow();
+    leader_contact_ = election_reset_event_;
+    NoteLinkRtt(request.link_rtt);
+
+    size_t new_commit_index =
+        std::min(request.leader_commit_index, prev_log_index);
+    if (new_commit_index > commit_index_) {
+      commit_index_ = new_commit_index;
+      NoteCommit();
+      WakeApplier();
+    }
+
+    response->term = term_;
+    response->success = true;
+    response->backlog = Backlog();
+    return true;
+  }
+
+  // Heartbeats
+
+  // Tick of heartbeat timer shared by all groups, every interval
+  // Idle peers get a heartbeat, peers with pending entries are woken up
+  // instead
+  // Peers that got any AppendEntries within the interval are skipped
+  void SendHeartbeats(Jiffies interval) {
+    std::lock_guard guard{mutex_};
+    if (state_ != NodeState::Leader) {
+      return;
+    }
+    if (!HasQuorumContact()) {
+      // CheckQuorum: leader is likely partitioned away from majority
+      LOG_INFO("Lost contact with majority, stepping down at term {}", term_);
+      BecomeFollower(term_);
+      // Known leader is from an older term, do not redirect clients to it
+      leader_.reset();
+      return;
+    }
+    auto now = node::rt::MonotonicNow();
+    if (transfer_target_.has_value() &&
+        now - transfer_started_ >= MinElectionTimeout()) {
+      LOG_INFO("Leadership transfer to {} timed out", *transfer_target_);
+      transfer_target_.reset();
+    }
+    for (auto& [peer, replicator] : replicators_) {
+      if (now - replicator.last_sent < interval ||
+          replicator.installing_snapshot) {
+        continue;
+      }
+      if (next_index_[peer] <= log_.Length()) {
+        replicator.heartbeat_due = true;
+        replicator.wakeups.TrySend(1);
+        continue;
+      }
+      bool probe = replicator.in_flight >= Window(peer);
+      send_append_(peer, PrepareAppendEntries(peer, term_, probe));
+    }
+  }
+
+  // Reply is empty on RPC error
+  void HandleAppendEntriesReply(
+      const std::string& peer, const OutgoingAppend& append,
+      const std::optional<raft::proto::AppendEntries::Response>& reply) {
+    std::lock_guard guard{mutex_};
+    const auto& request = append.request;
+    size_t term = request.term;
+    if (state_ != NodeState::Leader || term_ != term) {
+      LOG_INFO("other current term, exiting");
+      return;
+    }
+    auto& pipeline = replicators_[peer];
+    // Stale replies free their slots too, see Replicator::in_flight
+    --pipeline.in_flight;
+    bool current_epoch = pipeline.epoch == append.epoch;
+    auto& peer_metrics = metrics_.peers[peer];
+    if (!reply.has_value()) {
+      LOG_INFO("Error in AppendEntriesResponse");
+      ++peer_metrics.append_entries_failed;
+      if (current_epoch) {
+        // Entries may be lost, resend from match point on next wakeup
+        RewindReplicator(peer, match_index_[peer] + 1);
+      }
+      return;
+    }
+    auto rtt = node::rt::MonotonicNow() - append.sent_at;
+    peer_metrics.append_entries_rtt.Add(rtt);
+    peer_rtt_[peer].Add(rtt);
+    if (reply->term > term) {
+      LOG_INFO("term out of date in heartbeat reply");
+      BecomeFollower(reply->term);
+      return;
+    }
+    // Peer still follows us
+    acked_at_[peer] = std::max(acked_at_[peer], append.sent_at);
+    pipeline.backlogged =
+        reply->backlog >= replication_window_ * append_max_entries_;
+    if (append.round > acked_round_[peer]) {
+      acked_round_[peer] = append.round;
+      ConfirmReadIndexes();
+      WakeApplier();
+    }
+    if (reply->success) {
+      size_t last_index = request.prev_log_index + request.entries.size();
+      if (last_index > match_index_[peer]) {
+        match_index_[peer] = last_index;
+        next_index_[peer] = std::max(next_index_[peer], last_index + 1);
+        AdvanceCommitIndex();
+        MaybeSendTimeoutNow();
+      }
+    } else {
+      ++peer_metrics.append_entries_rejected;
+      if (current_epoch) {
+        RewindReplicator(peer, ConflictNextIndex(*reply));
+      }
+    }
+    pipeline.wakeups.TrySend(1);
+  }
+
+  // With mutex
+  // Well below min election timeout, also renews leader lease
+  // Leader paces heartbeats by its fastest link: every follower times
+  // out after at least 6 RTTs of its own link
+  Jiffies HeartbeatInterval() const {
+    if (state_ != NodeState::Leader) {
+      return Jiffies{Rtt()};
+    }
+    uint64_t fastest = 0;
+    for (const auto& [_, estimator] : peer_rtt_) {
+      if (estimator.HasSamples() &&
+          (fastest == 0 || estimator.Estimate() < fastest)) {
+        fastest = estimator.Estimate();
+      }
+    }
+    return Jiffies{BoundRtt(fastest > 0 ? fastest : NominalRtt())};
+  }
+
+  // For shared heartbeat timer
+  Jiffies HeartbeatTimerInterval() {
+    std::lock_guard guard{mutex_};
+    return HeartbeatInterval();
+  }
+
+  // Observability
+
+  // Counters are updated in place, gauges are filled only here
+  void Metrics(const raft::proto::Metrics::Request& /*request*/,
+               RaftMetrics* response) {
+    std::lock_guard guard{mutex_};
+    *response = metrics_;
+    response->state = StateName();
+    response->term = term_;
+    response->log_length = log_.Length();
+    response->commit_index = commit_index_;
+    response->last_applied = last_applied_;
+    {
+      std::lock_guard apply_guard{apply_mutex_};
+      response->sessions = sessions_.Size();
+    }
+    response->rtt = Rtt();
+    response->election_timeout = election_timeout_;
+    if (state_ == NodeState::Leader) {
+      for (auto& [peer, replicator] : replicators_) {
+        auto& peer_metrics = response->peers[peer];
+        peer_metrics.next_index = next_index_[peer];
+        peer_metrics.match_index = match_index_[peer];
+        peer_metrics.lag = log_.Length() - match_index_[peer];
+        peer_metrics.in_flight = replicator.in_flight;
+        peer_metrics.rtt_estimate = peer_rtt_[peer].Estimate();
+      }
+    }
+  }
+
+  // With mutex
+  std::string StateName() const {
+    switch (state_) {
+      case NodeState::Candidate:
+        return "Candidate";
+      case NodeState::Follower:
+        return IsVoter(node::rt::HostName()) ? "Follower" : "Learner";
+      case NodeState::Leader:
+        return "Leader";
+    }
+    return "Unknown";
+  }
+
+  // With mutex
+  // After commit_index_ advance, for commit-to-apply latency
+  void NoteCommit() {
+    commit_times_.emplace_back(commit_index_, node::rt::MonotonicNow());
+  }
+
+  // Leadership transfer
+
+  // For planned restarts: leader stops accepting commands, catches target
+  // up and lets it start election immediately via TimeoutNow
+  // Transfer is aborted after min election timeout
+  void TransferLeadership(
+      const raft::proto::TransferLeadership::Request& request,
+      raft::proto::TransferLeadership::Response* response) {
+    std::lock_guard guard{mutex_};
+    if (state_ != NodeState::Leader) {
+      return;
+    }
+    std::string target =
+        request.target.empty() ? MostUpToDatePeer() : request.target;
+    if (replicators_.count(target) == 0 || !IsVoter(target)) {
+      LOG_INFO("Unknown leadership transfer target '{}'", target);
+      return;
+    }
+    LOG_INFO("Transferring leadership to {} at term {}", target, term_);
+    transfer_target_ = target;
+    transfer_started_ = node::rt::MonotonicNow();
+    timeout_now_sent_ = false;
+    FlushBatch();
+    replicators_[target].wakeups.TrySend(1);
+    MaybeSendTimeoutNow();
+    response->target = target;
+  }
+
+  void TimeoutNow(const raft::proto::TimeoutNow::Request& request,
+                  raft::proto::TimeoutNow::Response* response) {
+    std::lock_guard guard{mutex_};
+    if (request.term > term_) {
+      BecomeFollower(request.term);
+    }
+    if (request.term == term_ && state_ == NodeState::Follower) {
+      LOG_INFO("RPC_TN: {} hands off leadership at term {}", request.leader,
+               term_);
+      StartElection(/*transfer=*/true);
+    }
+    response->term = term_;
+    PersistHardState();
+  }
+
+  // With mutex
+  std::string MostUpToDatePeer() {
+    std::string best;
+    for (auto& [peer, _] : replicators_) {
+      if (!IsVoter(peer)) {
+        continue;
+      }
+      if (best.empty() || match_index_[peer] > match_index_[best]) {
+        best = peer;
+      }
+    }
+    return best;
+  }
+
+  // With mutex
+  // Target must have the whole leader log before it starts election
+  void MaybeSendTimeoutNow() {
+    if (!transfer_target_.has_value() || timeout_now_sent_ ||
+        match_index_[*transfer_target_] < log_.Length()) {
+      return;
+    }
+    timeout_now_sent_ = true;
+    // Voters ignore our lease from now on, even if transfer is aborted
+    lease_revoked_ = true;
+    raft::proto::TimeoutNow::Request request{term_, node::rt::HostName(),
+                                             group_};
+    await::fibers::Go([&, peer = *transfer_target_, term = term_, request,
+                       self{shared_from_this()}]() {
+      auto result =
+          await::fibers::Await(commute::rpc::Call("Raft.TimeoutNow")
+                                   .Args(request)
+                                   .Via(Peer::Channel(peer))
+                                   .Start()
+                                   .As<raft::proto::TimeoutNow::Response>());
+      if (result.HasError() || result.ValueOrThrow().unknown_group) {
+        return;
+      }
+      auto reply = result.ValueOrThrow();
+      std::lock_guard guard{mutex_};
+      if (reply.term > term_) {
+        BecomeFollower(reply.term);
+      } else if (state_ == NodeState::Leader && term_ == term) {
+        // Target refused, retry while transfer is not aborted
+        timeout_now_sent_ = false;
+      }
+    });
+  }
+
+  // Learners
+
+  // Promotes caught up learner with single-server membership change
+  void PromoteLearner(const raft::proto::PromoteLearner::Request& request,
+                      raft::proto::PromoteLearner::Response* response) {
+    std::lock_guard guard{mutex_};
+    response->accepted = false;
+    const auto& learner = request.learner;
+    if (state_ != NodeState::Leader || transfer_target_.has_value() ||
+        learners_.count(learner) == 0 || IsVoter(learner)) {
+      return;
+    }
+    // One change at a time, and only after leader has committed an entry
+    // from its term, otherwise changes of different leaders may overlap
+    if (log_.Term(commit_index_) != term_ ||
+        (!promotions_.empty() && promotions_.rbegin()->first > commit_index_)) {
+      LOG_INFO("Membership change in progress, postpone promotion");
+      return;
+    }
+    if (match_index_[learner] + append_max_entries_ < log_.Length()) {
+      LOG_INFO("Learner {} is not caught up: match index {}, log length {}",
+               learner, match_index_[learner], log_.Length());
+      return;
+    }
+    FlushBatch();
+    size_t index = log_.Length() + 1;
+    LOG_INFO("Promoting learner {} at index {}", learner, index);
+    Command command{kPromoteLearner, muesli::Serialize(learner),
+                    RequestId{"raft", index}, /*readonly=*/false};
+    NoteMembershipChange(index, LogEntry{command, term_});
+    batch_.push_back(LogEntry{std::move(command), term_});
+    FlushBatch();
+    response->accepted = true;
+  }
+
+  // Leader side of follower reads
+  void ReadIndex(const raft::proto::ReadIndex::Request& /*request*/,
+                 raft::proto::ReadIndex::Response* response) {
+    std::unique_lock lock{mutex_};
+    if (state_ != NodeState::Leader || log_.Term(commit_index_) != term_) {
+      response->ok = false;
+      return;
+    }
+    auto [future, promise] = await::futures::MakeContract<size_t>();
+    index_reads_.push_back({commit_index_, ++read_round_, std::move(promise)});
+    WakeReplicators(/*heartbeat=*/true);
+    ConfirmReadIndexes();
+    lock.unlock();
+
+    size_t read_index = await::fibers::Await(std::move(future)).ValueOrThrow();
+    response->ok = read_index > 0;
+    response->read_index = read_index;
+  }
+
+  // With mutex
+  // Follower (or learner) gets read index from leader and serves read
+  // locally once it has applied log up to read index
+  void ServeFollowerRead(Command command, Promise<proto::Response> promise) {
+    auto leader = *leader_;
+    raft::proto::ReadIndex::Request request{group_};
+    await::fibers::Go([&, leader, request, command = std::move(command),
+                       promise = std::move(promise),
+                       self{shared_from_this()}]() mutable {
+      auto result =
+          await::fibers::Await(commute::rpc::Call("Raft.ReadIndex")
+                                   .Args(request)
+                                   .Via(Peer::Channel(leader))
+                                   .Start()
+                                   .As<raft::proto::ReadIndex::Response>());
+      if (result.HasError() || !result.ValueOrThrow().ok) {
+        std::move(promise).SetValue(proto::RedirectToLeader{leader});
+        return;
+      }
+      size_t read_index = result.ValueOrThrow().read_index;
+      std::lock_guard guard{mutex_};
+      LOG_INFO("Serving follower read {} at index {}", command, read_index);
+      pending_reads_.push_back(
+          {std::move(command), read_index, /*round=*/0, std::move(promise)});
+      WakeApplier();
+    });
+  }
+
+  // With mutex
+  void ConfirmReadIndexes() {
+    size_t confirmed_round = QuorumValue(read_round_, acked_round_);
+    while (!index_reads_.empty() &&
+           index_reads_.front().round <= confirmed_round) {
+      auto& read = index_reads_.front();
+      std::move(read.promise).SetValue(read.read_index);
+      index_reads_.pop_front();
+    }
+  }
+
+  // With mutex
+  // Entries appended to local log but not applied yet
+  size_t Backlog() const {
+    return log_.Length() - std::min(last_applied_, log_.Length());
+  }
+
+  // Compaction
+
+  // Snapshot arrives in chunks, mutex_ is released while complete
+  // snapshot is deserialized and stored
+  void InstallSnapshot(const raft::proto::InstallSnapshot::Request& request,
+                       raft::proto::InstallSnapshot::Response* response) {
+    std::lock_guard snapshot_guard{snapshot_mutex_};
+    std::unique_lock lock{mutex_};
+    LOG_INFO("RPC_IS: START from leader {}, term {}, last included ({}/{}), "
+             "offset {}",
+             request.leader, request.term, request.last_included_index,
+             request.last_included_term, request.offset);
+    if (request.term > term_) {
+      LOG_INFO("RPC_IS: term out of date");
+      BecomeFollower(request.term);
+    }
+
+    if (request.term == term_) {
+      leader_ = request.leader;
+      if (state_ != NodeState::Follower) {
+        BecomeFollower(request.term);
+      }
+      election_reset_event_ = node::rt::MonotonicNow();
+      leader_contact_ = election_reset_event_;
+
+      if (BufferSnapshotChunk(request, response)) {
+        auto data = std::exchange(incoming_, {}).data;
+        if (request.last_included_index > commit_index_) {
+          lock.unlock();
+          auto snapshot = muesli::Deserialize<Snapshot>(data);
+          lock.lock();
+          // Term may have changed while deserializing
+          if (request.term == term_) {
+            InstallReceivedSnapshot(request, std::move(snapshot), lock);
+          }
+        }
+      }
+    }
+    response->term = term_;
+    PersistHardState();
   }
 
  private:
@@ -270,135 +860,267 @@ class Raft : public IReplica,
       std::move(it->second).SetValue(proto::NotALeader{});
       commit_channels_.erase(it++);
     }
+    admitted_bytes_ = 0;
+    admitted_per_client_.clear();
+
+    for (auto& read : pending_reads_) {
+      std::move(read.promise).SetValue(proto::NotALeader{});
+    }
+    pending_reads_.clear();
+
+    for (auto& read : index_reads_) {
+      std::move(read.promise).SetValue(0);
+    }
+    index_reads_.clear();
+
+    if (state_ == NodeState::Leader) {
+      ++metrics_.step_downs;
+    }
+
+    // Pending commands were never appended, their promises are aborted above
+    batch_.clear();
+    batch_bytes_ = 0;
+    ++batch_id_;
 
     state_ = NodeState::Follower;
-    term_ = term;
-    voted_for_.reset();
+    transfer_target_.reset();
+    if (term > term_) {
+      term_ = term;
+      voted_for_.reset();
+      ++metrics_.term_changes;
+    }
 
-    await::fibers::Go([&, term, self{shared_from_this()}]() {
-      RunElectionTimer(term);
-    });
+    // Let replicators of the previous term exit
+    WakeReplicators(/*heartbeat=*/false);
+
+    // Rearm election timer with a fresh timeout
+    election_timeout_ = ElectionTimeout();
+    election_timer_channel_.TrySend(1);
+  }
+
+  // Admission control
+
+  // With mutex
+  // Bounds uncommitted log tail and commands waiting for commit,
+  // so that lagging followers do not blow up leader memory and latency
+  bool Admit(const Command& command) {
+    size_t uncommitted = log_.Length() + batch_.size() - commit_index_;
+    auto& client_in_flight =
+        admitted_per_client_[command.request_id.client_id];
+    if (uncommitted >= admission_max_entries_ ||
+        admitted_bytes_ + command.request.size() > admission_max_bytes_ ||
+        client_in_flight >= admission_max_per_client_) {
+      LOG_INFO("Overloaded: {} uncommitted entries, {} bytes, reject {}",
+               uncommitted, admitted_bytes_, command);
+      if (client_in_flight == 0) {
+        admitted_per_client_.erase(command.request_id.client_id);
+      }
+      return false;
+    }
+    admitted_bytes_ += command.request.size();
+    ++client_in_flight;
+    return true;
+  }
+
+  // With mutex
+  // Admitted command is applied
+  void Release(const Command& command) {
+    admitted_bytes_ -= command.request.size();
+    auto it = admitted_per_client_.find(command.request_id.client_id);
+    if (--it->second == 0) {
+      admitted_per_client_.erase(it);
+    }
+  }
+
+  // Group commit
+
+  // With mutex
+  // Appends all batched commands with a single log write
+  // Entries are sent to followers before the local write, so disk and
+  // network latencies overlap. Leader counts itself in commit quorum
+  // only after the write completes
+  void FlushBatch() {
+    ++batch_id_;
+    if (batch_.empty()) {
+      return;
+    }
+    metrics_.batch_size.Add(batch_.size());
+    log_.Stage(batch_);
+    for (auto& [peer, _] : replicators_) {
+      Replicate(peer, term_);
+    }
+    // Written by log writer without mutex
+    log_writer_channel_.TrySend(1);
+    LOG_INFO("Staged batch of {} commands at term {}.", batch_.size(), term_);
+    batch_.clear();
+    batch_bytes_ = 0;
+  }
+
+  // Log domain: writes staged entries while RPC handlers, replicators
+  // and new commands keep going under mutex
+  // Batches staged during a write are coalesced into the next one
+  void RunLogWriter() {
+    while (true) {
+      log_writer_channel_.Receive();
+      log_.Persist();
+
+      std::lock_guard guard{mutex_};
+      if (state_ == NodeState::Leader) {
+        AdvanceCommitIndex();
+      }
+    }
   }
 
   // With mutex
   void BecomeLeader() {
     state_ = NodeState::Leader;
+    ++metrics_.leaderships;
+    leader_since_ = node::rt::MonotonicNow();
+    transfer_target_.reset();
+    lease_revoked_ = false;
     auto len = log_.Length();
 
+    replicators_.clear();
     for (auto peer : ListPeers().WithoutMe()) {
       next_index_[peer] = len + 1;
       match_index_[peer] = 0;
+      acked_round_[peer] = 0;
+      acked_at_[peer] = 0;
+      auto& replicator = replicators_[peer];
+      await::fibers::Go([&, peer, term = term_, wakeups = replicator.wakeups,
+                         self{shared_from_this()}]() {
+        RunReplicator(peer, term, wakeups);
+      });
     }
     LOG_INFO("Became leader with term {}", term_);
-    await::fibers::Go([&, self{shared_from_this()}]() {
-      std::unique_lock lock{mutex_};
-      SendAEs(term_);
-      lock.unlock();
-      await::fibers::Channel<int> heartbeat_channel{1};
-      await::fibers::Go(
-          [&, heartbeat_channel, self{shared_from_this()}]() mutable {
-            node::rt::SleepFor(500);
-            heartbeat_channel.Send(123);
-          });
-      bool do_send;
-      while (true) {
-        do_send = false;
-        auto value =
-            await::fibers::Select(heartbeat_channel, trigger_ae_channel_);
-        switch (value.index()) {
-          case 0:
-            // heartbeat
-            do_send = true;
-            await::fibers::Go(
-                [&, heartbeat_channel, self{shared_from_this()}]() mutable {
-                  node::rt::SleepFor(500);
-                  heartbeat_channel.Send(123);
-                });
-          case 1:
-            do_send = true;
-        }
-        if (do_send) {
-          lock.lock();
-          if (state_ != NodeState::Leader) {
-            return;
-          }
-          SendAEs(term_);
-          lock.unlock();
-        }
-      }
-    });
+    // Assert leadership right away, then on shared heartbeat timer
+    WakeReplicators(/*heartbeat=*/true);
   }
 
  private:
   // Fibers
 
-  void RunElectionTimer(size_t term) {
-    auto timeout = ElectionTimeout();
-    Jiffies ticker_interval = 500;
-    LOG_INFO("Election timer started, timeout {} at term {}", timeout, term);
-    await::fibers::Channel<int> ticker_channel{1};
-
-    await::fibers::Go([&, ticker_channel, ticker_interval,
-                       self{shared_from_this()}]() mutable {
-      node::rt::SleepFor(ticker_interval);
-      ticker_channel.Send(123);
-    });
+  // Single election timer per replica
+  // Sleeps until election_reset_event_ + election_timeout_, heartbeats
+  // only move the deadline, parked while leader
+  void RunElectionTimer() {
     while (true) {
-      ticker_channel.Receive();
-      std::lock_guard guard{mutex_};
+      std::unique_lock lock{mutex_};
       if (state_ == NodeState::Leader) {
-        LOG_INFO("in election timer, state == leader, leaving");
-        return;
+        lock.unlock();
+        election_timer_channel_.Receive();
+        continue;
       }
-      if (term != term_) {
-        LOG_INFO("in election timer, term changed, leaving");
-        return;
+      if (!IsVoter(node::rt::HostName())) {
+        // Learners never start elections, recheck after promotion
+        Jiffies recheck = MinElectionTimeout();
+        lock.unlock();
+        node::rt::SleepFor(recheck);
+        continue;
       }
-      if (node::rt::MonotonicNow() - election_reset_event_ >= timeout) {
-        LOG_INFO("Starting election");
-        StartElection();
-        return;
+      auto elapsed = node::rt::MonotonicNow() - election_reset_event_;
+      if (elapsed >= election_timeout_) {
+        LOG_INFO("Starting pre-vote, timeout {} at term {}", election_timeout_,
+                 term_);
+        StartPreVote();
+        continue;
       }
-      await::fibers::Go([&, ticker_channel, ticker_interval,
-                         self{shared_from_this()}]() mutable {
-        //        LOG_INFO("Ticker");
-        node::rt::SleepFor(ticker_interval);
-        //        LOG_INFO("Ticker woke up");
-        ticker_channel.Send(123);
-      });
+      Jiffies remaining = election_timeout_ - elapsed;
+      lock.unlock();
+      node::rt::SleepFor(remaining);
     }
   }
 
  private:
   // Misc
 
-  void StartElection() {
-    // With mutex
-    state_ = NodeState::Candidate;
-    ++term_;
-    auto saved_cur_term = term_;
+  // With mutex
+  // PreVote: asks peers whether they would vote for us in the next term
+  // without bumping term_, real election starts only on majority
+  void StartPreVote() {
+    ++metrics_.pre_votes_started;
     election_reset_event_ = node::rt::MonotonicNow();
-    voted_for_ = node::rt::HostName();
-    // TODO: maybe leader_.reset();
-    PersistToStorage();
-    LOG_INFO("became candidate for term {}.", saved_cur_term);
+    election_timeout_ = ElectionTimeout();
+    if (VoterCount() == 1) {
+      StartElection();
+      return;
+    }
+    auto saved_cur_term = term_;
+    auto round = ++pre_vote_round_;
     std::shared_ptr<size_t> votes_received = std::make_shared<size_t>(1);
-    for (auto peer : ListPeers().WithoutMe()) {
-      await::fibers::Go([&, peer, saved_cur_term, votes_received,
+    auto [last_log_index, last_log_term] = LastIndex();
+    raft::proto::RequestVote::Request request{
+        saved_cur_term + 1, node::rt::HostName(), last_log_index,
+        last_log_term,      /*pre_vote=*/true,    /*transfer=*/false,
+        group_};
+    for (auto peer : OtherVoters()) {
+      await::fibers::Go([&, peer, saved_cur_term, round, request,
+                         votes_received, self{shared_from_this()}]() {
+        auto result =
+            await::fibers::Await(commute::rpc::Call("Raft.RequestVote")
+                                     .Args(request)
+                                     .Via(Peer::Channel(peer))
+                                     .Start()
+                                     .As<raft::proto::RequestVote::Response>());
+        if (result.HasError() || result.ValueOrThrow().unknown_group) {
+          return;
+        }
+        auto reply = result.ValueOrThrow();
+        std::lock_guard guard{mutex_};
+        if (state_ == NodeState::Leader || term_ != saved_cur_term ||
+            pre_vote_round_ != round) {
+          return;
+        }
+        if (reply.term > term_) {
+          BecomeFollower(reply.term);
+          return;
+        }
+        if (reply.vote_granted) {
+          ++(*votes_received);
+          if (*votes_received >= Majority()) {
+            ++pre_vote_round_;
+            StartElection();
+          }
+        }
+      });
+    }
+  }
+
+  void StartElection(bool transfer = false) {
+    // With mutex
+    state_ = NodeState::Candidate;
+    ++term_;
+    ++metrics_.elections_started;
+    ++metrics_.term_changes;
+    auto saved_cur_term = term_;
+    election_reset_event_ = node::rt::MonotonicNow();
+    election_timeout_ = ElectionTimeout();
+    voted_for_ = node::rt::HostName();
+    // TODO: maybe leader_.reset();
+    PersistHardState();
+    LOG_INFO("became candidate for term {}.", saved_cur_term);
+    if (VoterCount() == 1) {
+      BecomeLeader();
+      return;
+    }
+    std::shared_ptr<size_t> votes_received = std::make_shared<size_t>(1);
+    for (auto peer : OtherVoters()) {
+      await::fibers::Go([&, peer, saved_cur_term, votes_received, transfer,
                          self{shared_from_this()}]() {
         mutex_.Lock();
         auto [last_log_index, last_log_term] = LastIndex();
         mutex_.Unlock();
         raft::proto::RequestVote::Request request{
             saved_cur_term, node::rt::HostName(), last_log_index,
-            last_log_term};
+            last_log_term,  /*pre_vote=*/false,   transfer,
+            group_};
         auto result =
             await::fibers::Await(commute::rpc::Call("Raft.RequestVote")
                                      .Args(request)
                                      .Via(Peer::Channel(peer))
                                      .Start()
                                      .As<raft::proto::RequestVote::Response>());
-        if (result.HasError()) {
+        if (result.HasError() || result.ValueOrThrow().unknown_group) {
           LOG_INFO("Error in RequestVoteResponse");
           return;
         }
@@ -419,7 +1141,7 @@ class Raft : public IReplica,
         } else if (reply.term == saved_cur_term) {
           if (reply.vote_granted) {
             ++(*votes_received);
-            if ((*votes_received) * 2 >= NodeCount() + 1) {
+            if (*votes_received >= Majority()) {
               BecomeLeader();
               return;
             }
@@ -427,142 +1149,721 @@ class Raft : public IReplica,
         }
       });
     }
-    await::fibers::Go([&, saved_cur_term, self{shared_from_this()}]() {
-      RunElectionTimer(saved_cur_term);
-    });
   }
 
   std::tuple<size_t, size_t> LastIndex() {
     return {log_.Length(), log_.LastLogTerm()};
   }
 
-  void SendAEs(size_t saved_cur_term) {
-    LOG_INFO("Sending AEs at term {}", saved_cur_term);
-    for (auto peer : ListPeers().WithoutMe()) {
-      await::fibers::Go([&, saved_cur_term, peer, self{shared_from_this()}]() {
-        std::unique_lock lock1(mutex_);
-        auto ni = next_index_[peer];
-        auto prev_log_index = ni - 1;
-        size_t prev_log_term = 0;
-        if (prev_log_index > 0) {
-          prev_log_term = log_.Term(prev_log_index);
-        }
-        LogEntries entries;
-        for (auto index = ni; index <= log_.Length(); ++index) {
-          entries.push_back(log_.Read(index));
-        }
-        raft::proto::AppendEntries::Request request{
-            saved_cur_term, node::rt::HostName(), prev_log_index, prev_log_term,
-            entries,        commit_index_};
-        lock1.unlock();
-        LOG_INFO("Sending AE to {}", peer);
-        auto result = await::fibers::Await(
-            commute::rpc::Call("Raft.AppendEntries")
-                .Args(request)
-                .Via(Peer::Channel(peer))
-                .Start()
-                .As<raft::proto::AppendEntries::Response>());
-        if (result.HasError()) {
-          LOG_INFO("Error in AppendEntriesResponse");
-          return;
+  // Replication pipeline
+
+  // With mutex
+  void WakeReplicators(bool heartbeat) {
+    for (auto& [peer, replicator] : replicators_) {
+      replicator.heartbeat_due |= heartbeat;
+      replicator.wakeups.TrySend(1);
+    }
+  }
+
+  // One long-lived fiber per peer and leader term
+  void RunReplicator(const std::string& peer, size_t term,
+                     await::fibers::Channel<int> wakeups) {
+    while (true) {
+      wakeups.Receive();
+      std::lock_guard guard{mutex_};
+      if (state_ != NodeState::Leader || term_ != term) {
+        return;
+      }
+      Replicate(peer, term);
+    }
+  }
+
+  // With mutex
+  // Fills replication window of peer
+  void Replicate(const std::string& peer, size_t term) {
+    auto& replicator = replicators_[peer];
+    if (replicator.installing_snapshot) {
+      return;
+    }
+    bool heartbeat = std::exchange(replicator.heartbeat_due, false);
+    size_t window = Window(peer);
+    while (replicator.in_flight < window &&
+           (heartbeat || next_index_[peer] <= log_.Length())) {
+      heartbeat = false;
+      if (next_index_[peer] <= log_.Base().index) {
+        // Entries are compacted
+        SendInstallSnapshot(peer, term);
+        break;
+      }
+      SendAppendEntries(peer, term, /*probe=*/false);
+    }
+    if (heartbeat) {
+      // Window is full: keep follower alive without moving next_index_
+      SendAppendEntries(peer, term, /*probe=*/true);
+    }
+  }
+
+  // With mutex
+  void SendAppendEntries(const std::string& peer, size_t term, bool probe) {
+    send_append_(peer, PrepareAppendEntries(peer, term, probe));
+  }
+
+  // With mutex
+  // Optimistically advances next_index_[peer] past the sent entries,
+  // probe requests are empty and start right after match_index_[peer]
+  // Non-empty request carries at least one and at most
+  // append_max_entries_ / append_max_bytes_ entries
+  OutgoingAppend PrepareAppendEntries(const std::string& peer, size_t term,
+                                      bool probe) {
+    auto& replicator = replicators_[peer];
+    size_t prev_log_index =
+        probe ? std::max(match_index_[peer], log_.Base().index)
+              : next_index_[peer] - 1;
+    size_t prev_log_term = 0;
+    if (prev_log_index > 0) {
+      prev_log_term = log_.Term(prev_log_index);
+    }
+    RawLogEntries entries;
+    if (!probe) {
+      size_t bytes = 0;
+      for (auto index = prev_log_index + 1;
+           index <= log_.Length() && entries.size() < append_max_entries_;
+           ++index) {
+        auto entry = log_.ReadRaw(index);
+        entry.config = promotions_.count(index) > 0;
+        if (!entries.empty() &&
+            bytes + entry.bytes.size() > append_max_bytes_) {
+          break;
         }
-        raft::proto::AppendEntries::Response reply = result.ValueOrThrow();
-        lock1.lock();
-        if (term_ != saved_cur_term) {
-          LOG_INFO("other current term, exiting");
-          return;
+        bytes += entry.bytes.size();
+        entries.push_back(std::move(entry));
+      }
+      next_index_[peer] = prev_log_index + entries.size() + 1;
+    }
+    ++replicator.in_flight;
+    replicator.last_sent = node::rt::MonotonicNow();
+    ++metrics_.peers[peer].append_entries_sent;
+    if (log_.Writing()) {
+      ++metrics_.appends_during_log_write;
+    }
+    LOG_INFO("Sending AE to {}, prev index {}, {} entries", peer,
+             prev_log_index, entries.size());
+
+    raft::proto::AppendEntries::Request request{
+        term,    node::rt::HostName(), prev_log_index, prev_log_term,
+        std::move(entries), commit_index_, group_, peer_rtt_[peer].Estimate()};
+    return {std::move(request), replicator.epoch, read_round_,
+            node::rt::MonotonicNow()};
+  }
+
+  // Backlogged follower gets one request at a time
+  size_t Window(const std::string& peer) {
+    return replicators_[peer].backlogged ? 1 : replication_window_;
+  }
+
+  // With mutex
+  // Ignores failures of in-flight requests of current epoch and restarts
+  // replication to peer from next_index once their slots drain
+  void RewindReplicator(const std::string& peer, size_t next_index) {
+    auto& replicator = replicators_[peer];
+    next_index_[peer] = std::max(std::min(next_index, next_index_[peer]),
+                                 match_index_[peer] + 1);
+    ++replicator.epoch;
+    LOG_INFO("Rewind replication to {} at index {}", peer, next_index_[peer]);
+  }
+
+  // With mutex
+  size_t ConflictNextIndex(const raft::proto::AppendEntries::Response& reply) {
+    if (reply.conflict_term > 0) {
+      size_t last_index_of_term = log_.LastIndexOfTerm(reply.conflict_term);
+      if (last_index_of_term > 0) {
+        return last_index_of_term + 1;
+      }
+    }
+    return reply.conflict_index;
+  }
+
+  // With mutex
+  void AdvanceCommitIndex() {
+    size_t saved_commit_index = commit_index_;
+
+    // Largest index replicated on a majority
+    // Leader own entries count once they are durable
+    size_t quorum_index = QuorumValue(log_.DurableLength(), match_index_);
+
+    // Only entries from current term are committed by counting replicas
+    if (quorum_index > commit_index_ && log_.Term(quorum_index) == term_) {
+      commit_index_ = quorum_index;
+      NoteCommit();
+    }
+
+    if (saved_commit_index != commit_index_) {
+      WakeApplier();
+    }
+  }
+
+  // With mutex
+  // Largest value reached by a majority of voters, learners are ignored
+  template <typename T>
+  T QuorumValue(T my_value, const std::map<std::string, T>& peer_values) const {
+    std::vector<T> values{my_value};
+    for (const auto& [peer, value] : peer_values) {
+      if (IsVoter(peer)) {
+        values.push_back(value);
+      }
+    }
+    size_t majority = Majority();
+    if (values.size() < majority) {
+      // Peer values are tracked by leader only
+      return T{};
+    }
+    std::nth_element(values.begin(), values.begin() + (majority - 1),
+                     values.end(), std::greater<>());
+    return values[majority - 1];
+  }
+
+  // Membership
+
+  // Last raft.learners hosts of sorted pool
+  std::set<std::string> InitialLearners() {
+    auto hosts = ListPeers().WithMe();
+    std::sort(hosts.begin(), hosts.end());
+    size_t learners = std::min(
+        node::rt::Config()->GetInt<size_t>("raft.learners"), hosts.size() - 1);
+    return {hosts.end() - learners, hosts.end()};
+  }
+
+  static bool IsMembershipChange(const Command& command) {
+    return command.type == kPromoteLearner;
+  }
+
+  // With mutex
+  void NoteMembershipChange(size_t index, const LogEntry& entry) {
+    if (IsMembershipChange(entry.command)) {
+      promotions_[index] =
+          muesli::Deserialize<std::string>(entry.command.request);
+    }
+  }
+
+  // With mutex
+  // Latest membership in local log, committed or not
+  bool IsVoter(const std::string& host) const {
+    if (learners_.count(host) == 0) {
+      return true;
+    }
+    for (const auto& [_, promoted] : promotions_) {
+      if (promoted == host) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // With mutex
+  size_t VoterCount() const {
+    size_t learners = 0;
+    for (const auto& host : learners_) {
+      learners += IsVoter(host) ? 0 : 1;
+    }
+    return NodeCount() - learners;
+  }
+
+  // With mutex
+  size_t Majority() const {
+    return VoterCount() / 2 + 1;
+  }
+
+  // With mutex
+  std::vector<std::string> OtherVoters() const {
+    std::vector<std::string> voters;
+    for (auto& peer : ListPeers().WithoutMe()) {
+      if (IsVoter(peer)) {
+        voters.push_back(peer);
+      }
+    }
+    return voters;
+  }
+
+  // Leader lease
+
+  // With mutex
+  bool HoldsLease() const {
+    // Transfer target may win election without waiting for lease expiry
+    if (!lease_reads_ || state_ != NodeState::Leader ||
+        transfer_target_.has_value() || lease_revoked_ ||
+        log_.Term(commit_index_) != term_) {
+      return false;
+    }
+    auto now = node::rt::MonotonicNow();
+    // Majority acknowledged requests sent at this time or later
+    auto renewed_at = QuorumValue(now, acked_at_);
+    return now - renewed_at < LeaseDuration();
+  }
+
+  // With mutex
+  // Majority acknowledged leader requests within min election timeout
+  bool HasQuorumContact() const {
+    auto now = node::rt::MonotonicNow();
+    auto contact = std::max(QuorumValue(now, acked_at_), leader_since_);
+    return now - contact < MinElectionTimeout();
+  }
+
+  // With mutex
+  // Leader (this node included) is known to be alive
+  bool LeaderAlive() const {
+    if (state_ == NodeState::Leader) {
+      return HasQuorumContact();
+    }
+    return HeardFromLeaderRecently();
+  }
+
+  // With mutex
+  bool HeardFromLeaderRecently() const {
+    return leader_contact_ > 0 &&
+           node::rt::MonotonicNow() - leader_contact_ < MinElectionTimeout();
+  }
+
+  // Apply
+
+  // With or without mutex
+  std::optional<muesli::Bytes> FindSession(const RequestId& id) {
+    std::lock_guard apply_guard{apply_mutex_};
+    return sessions_.Find(id);
+  }
+
+  // With mutex
+  void WakeApplier() {
+    apply_channel_.TrySend(1);
+  }
+
+  // The only fiber that touches state_machine_ after Start
+  void RunApplier() {
+    while (true) {
+      apply_channel_.Receive();
+      while (ApplyBatch()) {
+      }
+    }
+  }
+
+  struct ApplyEntry {
+    Command command;
+    // See SessionTable::Admit
+    SessionTable::Status status;
+    // Response for commit channel once sessions_ are updated
+    muesli::Bytes response;
+
+    // Opening session only updates sessions_
+    bool ToStateMachine() const {
+      return status == SessionTable::Status::New &&
+             command.type != kOpenSession;
+    }
+  };
+
+  // Applies next batch of committed entries and serves ready reads
+  // mutex is held only to pick the batch and to resolve commit channels,
+  // state machine and sessions are updated in the apply domain
+  // Returns false if there is nothing to do
+  bool ApplyBatch() {
+    std::unique_lock lock{mutex_};
+    uint64_t epoch = install_epoch_;
+
+    if (pending_install_.has_value()) {
+      auto state = std::move(*pending_install_);
+      pending_install_.reset();
+      lock.unlock();
+      state_machine_->InstallSnapshot(std::move(state));
+      return true;
+    }
+
+    size_t last_index =
+        std::min(commit_index_, last_applied_ + apply_batch_size_);
+    std::vector<ApplyEntry> entries;
+    for (size_t index = last_applied_ + 1; index <= last_index; ++index) {
+      auto command = log_.Read(index).command;
+      if (IsMembershipChange(command)) {
+        continue;
+      }
+      entries.push_back({std::move(command), SessionTable::Status::New, {}});
+    }
+    {
+      // Sessions are opened and evicted in log order, before apply
+      std::lock_guard apply_guard{apply_mutex_};
+      std::set<RequestId> batch_ids;
+      for (auto& entry : entries) {
+        entry.status = sessions_.Admit(entry.command, sessions_capacity_);
+        if (entry.status == SessionTable::Status::New &&
+            !batch_ids.insert(entry.command.request_id).second) {
+          entry.status = SessionTable::Status::Duplicate;
         }
-        if (reply.term > saved_cur_term) {
-          LOG_INFO("term out of date in heartbeat reply");
-          BecomeFollower(reply.term);
-          return;
+      }
+    }
+
+    // Reads confirmed by heartbeat majority, served after the batch
+    std::vector<PendingRead> reads;
+    size_t confirmed_round = QuorumValue(read_round_, acked_round_);
+    while (!pending_reads_.empty()) {
+      auto& read = pending_reads_.front();
+      if (read.round > confirmed_round || read.read_index > last_index) {
+        break;
+      }
+      reads.push_back(std::move(read));
+      pending_reads_.pop_front();
+    }
+
+    if (entries.empty() && reads.empty()) {
+      return false;
+    }
+
+    lock.unlock();
+
+    for (auto& entry : entries) {
+      if (entry.ToStateMachine()) {
+        entry.response = state_machine_->Apply(entry.command);
+      }
+    }
+    for (auto& read : reads) {
+      auto response = state_machine_->Apply(read.command);
+      std::move(read.promise).SetValue(proto::Ack{std::move(response)});
+    }
+
+    {
+      std::lock_guard apply_guard{apply_mutex_};
+      if (install_epoch_ != epoch) {
+        // Snapshot replaced applied state
+        return true;
+      }
+      for (auto& entry : entries) {
+        if (entry.status == SessionTable::Status::New) {
+          sessions_.Record(entry.command, entry.response);
+        } else if (entry.status == SessionTable::Status::Duplicate) {
+          entry.response = sessions_.Find(entry.command.request_id)
+                               .value_or(muesli::Bytes{});
         }
-        if (state_ == NodeState::Leader && saved_cur_term == reply.term) {
-          if (reply.success) {
-            next_index_[peer] = ni + entries.size();
-            match_index_[peer] = next_index_[peer] - 1;
-
-            size_t saved_commit_index = commit_index_;
-            for (auto i = commit_index_ + 1; i <= log_.Length(); ++i) {
-              if (log_.Term(i) == term_) {
-                size_t match_count = 1;
-                for (auto peer_name : ListPeers().WithoutMe()) {
-                  if (match_index_[peer_name] >= i) {
-                    ++match_count;
-                  }
-                }
-                if (match_count * 2 >= NodeCount() + 1) {
-                  commit_index_ = i;
-                }
-              }
-            }
+      }
+    }
 
-            if (saved_commit_index != commit_index_) {
-              ++saved_commit_index;
-              for (; saved_commit_index <= commit_index_;
-                   ++saved_commit_index) {
-                LOG_INFO("Committing index {}", saved_commit_index);
-                auto command = log_.Read(saved_commit_index).command;
-                if (cache_.find(command.request_id) == cache_.end()) {
-                  auto response = state_machine_->Apply(command);
-                  cache_[command.request_id] = response;
-                  auto ch_iter = commit_channels_.find(command.request_id);
-                  if (ch_iter != commit_channels_.end()) {
-                    std::move(ch_iter->second).SetValue(proto::Ack{response});
-                    commit_channels_.erase(ch_iter);
-                  }
-                }
-                WHEELS_ASSERT(commit_channels_.find(command.request_id) ==
-                                  commit_channels_.end(),
-                              "Command already in commit_channels_");
-              }
-            }
-          } else {
-            if (reply.conflict_term > 0) {
-              size_t last_index_of_term = 0;
-              for (size_t i = log_.Length(); i > 0; --i) {
-                if (log_.Term(i) == reply.conflict_term) {
-                  last_index_of_term = i;
-                  break;
-                }
-              }
-              if (last_index_of_term > 0) {
-                next_index_[peer] = last_index_of_term + 1;
-              } else {
-                next_index_[peer] = reply.conflict_index;
-              }
-            } else {
-              next_index_[peer] = reply.conflict_index;
-            }
-          }
+    lock.lock();
+
+    if (install_epoch_ != epoch) {
+      return true;
+    }
+    for (auto& entry : entries) {
+      auto ch_iter = commit_channels_.find(entry.command.request_id);
+      if (ch_iter != commit_channels_.end()) {
+        if (entry.status == SessionTable::Status::Expired) {
+          const auto& client_id = entry.command.request_id.client_id;
+          std::move(ch_iter->second)
+              .SetValue(proto::SessionExpired{client_id});
+        } else {
+          std::move(ch_iter->second)
+              .SetValue(proto::Ack{std::move(entry.response)});
         }
-      });
+        commit_channels_.erase(ch_iter);
+        Release(entry.command);
+      }
+    }
+    last_applied_ = last_index;
+    LOG_INFO("Applied up to index {}", last_applied_);
+
+    auto now = node::rt::MonotonicNow();
+    while (!commit_times_.empty() &&
+           commit_times_.front().first <= last_applied_) {
+      metrics_.commit_to_apply.Add(now - commit_times_.front().second);
+      commit_times_.pop_front();
+    }
+
+    MaybeTakeSnapshot(lock);
+    return true;
+  }
+
+  // Compaction
+
+  // With mutex, releases it while serializing and storing state
+  // Applier only: state machine must match last_applied_
+  void MaybeTakeSnapshot(std::unique_lock<await::fibers::Mutex>& lock) {
+    if (last_applied_ - log_.Base().index < snapshot_threshold_) {
+      return;
+    }
+    size_t index = last_applied_;
+    uint64_t epoch = install_epoch_;
+    SessionTable sessions;
+    {
+      std::lock_guard apply_guard{apply_mutex_};
+      sessions = sessions_;
+    }
+
+    lock.unlock();
+    auto state = state_machine_->MakeSnapshot();
+    std::lock_guard snapshot_guard{snapshot_mutex_};
+    lock.lock();
+
+    if (install_epoch_ != epoch || index <= log_.Base().index) {
+      return;
+    }
+    LOG_INFO("Taking snapshot at index {}", index);
+    Snapshot snapshot{log_.BaseAt(index), std::move(state),
+                      std::move(sessions),
+                      {promotions_.begin(), promotions_.upper_bound(index)}};
+    lock.unlock();
+    // Snapshot must be durable before log prefix is dropped
+    // snapshot_mutex_ keeps log base until then
+    storage_.Store("snapshot", snapshot);
+    lock.lock();
+    log_.TruncatePrefix(index);
+  }
+
+  // With mutex and snapshot_mutex_
+  // Returns true if request completes snapshot in incoming_
+  bool BufferSnapshotChunk(
+      const raft::proto::InstallSnapshot::Request& request,
+      raft::proto::InstallSnapshot::Response* response) {
+    if (request.offset == 0) {
+      incoming_ = {request.term, request.last_included_index, {}};
+    } else if (incoming_.term != request.term ||
+               incoming_.index != request.last_included_index ||
+               incoming_.data.size() != request.offset) {
+      // Chunk of another transfer, leader starts over
+      return false;
+    }
+    incoming_.data.append(request.data);
+    response->received = incoming_.data.size();
+    return request.done;
+  }
+
+  // With mutex and snapshot_mutex_, releases mutex while storing snapshot
+  void InstallReceivedSnapshot(
+      const raft::proto::InstallSnapshot::Request& request,
+      Snapshot snapshot, std::unique_lock<await::fibers::Mutex>& lock) {
+    size_t index = request.last_included_index;
+    if (index <= commit_index_) {
+      return;
+    }
+    // Retain log entries following snapshot
+    bool retain = index <= log_.Length() &&
+                  log_.Term(index) == request.last_included_term;
+    if (retain) {
+      snapshot.log_base = log_.BaseAt(index);
+      promotions_.erase(promotions_.begin(), promotions_.upper_bound(index));
+    } else {
+      snapshot.log_base = log_.ResetBase(index, request.last_included_term);
+      promotions_.clear();
+    }
+    promotions_.insert(snapshot.promotions.begin(),
+                       snapshot.promotions.end());
+    // Applier installs state and drops results of in-progress batch
+    pending_install_ = snapshot.state;
+    {
+      std::lock_guard apply_guard{apply_mutex_};
+      ++install_epoch_;
+      sessions_ = snapshot.sessions;
+    }
+    WakeApplier();
+    last_applied_ = index;
+    commit_index_ = std::max(commit_index_, index);
+    while (!commit_times_.empty() && commit_times_.front().first <= index) {
+      commit_times_.pop_front();
     }
+
+    // Snapshot must be durable before log prefix is dropped
+    if (retain) {
+      lock.unlock();
+      storage_.Store("snapshot", snapshot);
+      lock.lock();
+      log_.TruncatePrefix(index);
+    } else {
+      // Keep mutex: entries appended before the snapshot is durable would
+      // be read back as the old log after crash
+      storage_.Store("snapshot", snapshot);
+      log_.Reset(snapshot.log_base);
+    }
+    LOG_INFO("RPC_IS: installed snapshot at index {}", index);
+  }
+
+  // With mutex
+  // Snapshot is loaded, serialized and sent without mutex
+  void SendInstallSnapshot(const std::string& peer, size_t term) {
+    replicators_[peer].installing_snapshot = true;
+    ++metrics_.peers[peer].snapshots_sent;
+
+    await::fibers::Go([&, peer, term, self{shared_from_this()}]() {
+      raft::proto::InstallSnapshot::Request request;
+      auto reply = TransferSnapshot(peer, term, &request);
+
+      std::lock_guard guard{mutex_};
+      if (state_ != NodeState::Leader || term_ != term) {
+        return;
+      }
+      auto& pipeline = replicators_[peer];
+      pipeline.installing_snapshot = false;
+      if (!reply.has_value()) {
+        return;
+      }
+      if (reply->term > term) {
+        BecomeFollower(reply->term);
+        return;
+      }
+      match_index_[peer] =
+          std::max(match_index_[peer], request.last_included_index);
+      // Continue right after snapshot, drop everything sent before
+      next_index_[peer] = match_index_[peer] + 1;
+      ++pipeline.epoch;
+      AdvanceCommitIndex();
+      MaybeSendTimeoutNow();
+      pipeline.wakeups.TrySend(1);
+    });
+  }
+
+  // Without mutex
+  // Sends latest snapshot to peer chunk by chunk, fills request header
+  // Returns reply to the last chunk sent, std::nullopt if transfer failed
+  std::optional<raft::proto::InstallSnapshot::Response> TransferSnapshot(
+      const std::string& peer, size_t term,
+      raft::proto::InstallSnapshot::Request* request) {
+    muesli::Bytes data;
+    {
+      std::lock_guard snapshot_guard{snapshot_mutex_};
+      auto snapshot = storage_.TryLoad<Snapshot>("snapshot");
+      if (!snapshot.has_value()) {
+        WHEELS_PANIC("Log is compacted without snapshot");
+      }
+      *request = {term,
+                  node::rt::HostName(),
+                  snapshot->log_base.index,
+                  snapshot->log_base.term,
+                  /*offset=*/0,
+                  /*data=*/{},
+                  /*done=*/false,
+                  group_};
+      data = muesli::Serialize(*snapshot);
+    }
+    LOG_INFO("Sending snapshot at index {} to {}, {} bytes",
+             request->last_included_index, peer, data.size());
+
+    std::optional<raft::proto::InstallSnapshot::Response> reply;
+    for (size_t offset = 0; offset < data.size();
+         offset += snapshot_chunk_size_) {
+      request->offset = offset;
+      request->data = data.substr(offset, snapshot_chunk_size_);
+      request->done = offset + request->data.size() == data.size();
+
+      auto result = await::fibers::Await(
+          commute::rpc::Call("Raft.InstallSnapshot")
+              .Args(*request)
+              .Via(Peer::Channel(peer))
+              .Start()
+              .As<raft::proto::InstallSnapshot::Response>());
+      if (result.HasError() || result.ValueOrThrow().unknown_group) {
+        LOG_INFO("Error in InstallSnapshotResponse");
+        return std::nullopt;
+      }
+      reply = result.ValueOrThrow();
+      if (reply->term > term) {
+        return reply;
+      }
+      if (reply->received != offset + request->data.size()) {
+        LOG_INFO("Snapshot chunk at offset {} rejected by {}", offset, peer);
+        return std::nullopt;
+      }
+      std::lock_guard guard{mutex_};
+      if (state_ != NodeState::Leader || term_ != term) {
+        return std::nullopt;
+      }
+    }
+    return reply;
   }
 
  private:
-  Jiffies ElectionTimeout() const {
-    uint64_t rtt = node::rt::Config()->GetInt<uint64_t>("net.rtt");
-    // Your code goes here
-    return Jiffies{6 * rtt + node::rt::RandomNumber(100)};
+  // Timing
+
+  // Configured RTT, used until links are measured
+  uint64_t NominalRtt() const {
+    return node::rt::Config()->GetInt<uint64_t>("net.rtt");
   }
 
-  void PersistToStorage() {
-    LOG_INFO("Persisting");
-    if (voted_for_.has_value()) {
-      if (!persisted_voted_for_.has_value() ||
-          persisted_voted_for_.value() != voted_for_.value()) {
-        storage_.Store("votedFor", voted_for_.value());
-        persisted_voted_for_ = voted_for_.value();
+  // Bounds are percents of nominal RTT, see raft.rtt config
+  uint64_t MinRtt() const {
+    return std::max<uint64_t>(NominalRtt() * rtt_min_percent_ / 100, 1);
+  }
+
+  uint64_t MaxRtt() const {
+    return std::max(NominalRtt() * rtt_max_percent_ / 100, MinRtt());
+  }
+
+  uint64_t BoundRtt(uint64_t rtt) const {
+    return std::clamp(rtt, MinRtt(), MaxRtt());
+  }
+
+  // With mutex
+  // Estimated RTT that timeouts are derived from
+  // Leader measures links to peers and takes the slowest one,
+  // follower learns estimate of its link from leader
+  uint64_t Rtt() const {
+    uint64_t rtt = NominalRtt();
+    if (state_ == NodeState::Leader) {
+      uint64_t slowest = 0;
+      for (const auto& [_, estimator] : peer_rtt_) {
+        slowest = std::max(slowest, estimator.Estimate());
+      }
+      if (slowest > 0) {
+        rtt = slowest;
       }
+    } else if (link_rtt_ > 0) {
+      rtt = link_rtt_;
     }
-    if (persisted_term_ != term_) {
-      storage_.Store("currentTerm", term_);
-      persisted_term_ = term_;
+    return BoundRtt(rtt);
+  }
+
+  // With mutex
+  // Follower adopts leader estimate of their link, election timeout
+  // follows it from the next wait on
+  void NoteLinkRtt(uint64_t link_rtt) {
+    if (link_rtt == 0 || link_rtt == link_rtt_) {
+      return;
     }
-    if (persisted_commit_index_ != commit_index_) {
-      storage_.Store("commitIndex", commit_index_);
-      persisted_commit_index_ = commit_index_;
+    uint64_t rtt = Rtt();
+    link_rtt_ = link_rtt;
+    if (Rtt() != rtt) {
+      election_timeout_ = ElectionTimeout();
+    }
+  }
+
+  // With mutex
+  Jiffies MinElectionTimeout() const {
+    return Jiffies{6 * Rtt()};
+  }
+
+  // With mutex
+  // Preferred leader of the group times out first,
+  // so leadership of groups is spread across nodes
+  // Randomization is below preference bias, so it does not undo it
+  Jiffies ElectionTimeout() const {
+    uint64_t rtt = Rtt();
+    uint64_t bias = preferred_leader_ ? 0 : 2 * rtt;
+    return Jiffies{6 * rtt + bias + node::rt::RandomNumber(2 * rtt)};
+  }
+
+  bool IsPreferredLeader() {
+    if (group_count_ == 1) {
+      return true;
+    }
+    auto hosts = ListPeers().WithMe();
+    std::sort(hosts.begin(), hosts.end());
+    return hosts[group_ % hosts.size()] == node::rt::HostName();
+  }
+
+  // Min election timeout minus clock drift margin
+  // Lower RTT bound: followers may measure faster links than leader
+  Jiffies LeaseDuration() const {
+    return Jiffies{5 * MinRtt()};
+  }
+
+  // Must be called before RPC reply is released
+  void PersistHardState() {
+    HardState hard_state{term_, voted_for_.value_or("")};
+    if (hard_state != persisted_hard_state_) {
+      LOG_INFO("Persisting term {} and vote", term_);
+      storage_.Store("hardState", hard_state);
+      persisted_hard_state_ = hard_state;
     }
   }
 
@@ -577,44 +1878,406 @@ class Raft : public IReplica,
   }
 
  private:
+  const size_t group_;
+  const size_t group_count_;
+  AppendSender send_append_;
+  bool preferred_leader_{true};
+
+  // Lock domains:
+  // - mutex_: hard state, role, per-peer replication, commit index.
+  //   Per-peer state stays here: quorum of match indexes and acked
+  //   rounds is computed over all peers at once
+  // - log_: internally synchronized, written without mutex_ by log writer
+  // - apply_mutex_: client sessions, taken with or without mutex_
+  // - snapshot_mutex_: snapshot storage and incoming snapshot chunks,
+  //   held across storage I/O with mutex_ released
+  // Lock order: snapshot_mutex_, mutex_, apply_mutex_, log_
   await::fibers::Mutex mutex_;
 
   IStateMachinePtr state_machine_;
 
   Log log_;
+  // Wakes log writer after batch is staged
+  await::fibers::Channel<int> log_writer_channel_{1};
   node::store::StructStore storage_;
 
   size_t term_{0};
-  size_t persisted_term_{0};
   NodeState state_;
 
   std::optional<std::string> leader_;
   std::optional<std::string> voted_for_;
-  std::optional<std::string> persisted_voted_for_;
+  HardState persisted_hard_state_;
 
   // Peer -> next index id
   std::map<std::string, size_t> next_index_;
   // Peer -> match index id
   std::map<std::string, size_t> match_index_;
 
+  // Per-peer AppendEntries pipeline
+  struct Replicator {
+    // Wakes up replicator fiber
+    await::fibers::Channel<int> wakeups{1};
+    // Requests still waiting for reply, of any epoch: requests of stale
+    // epochs hold their slots until they drain, so window is never exceeded
+    size_t in_flight{0};
+    // Bumped on each rewind of next index, stale failures are ignored
+    uint64_t epoch{0};
+    bool heartbeat_due{false};
+    // Last AppendEntries sent, heartbeats are suppressed for busy peers
+    node::time::MonotonicTime last_sent{0};
+    // Follower reported too many unapplied entries
+    bool backlogged{false};
+    // Nothing else is sent to peer while snapshot is in flight
+    bool installing_snapshot{false};
+  };
+  std::map<std::string, Replicator> replicators_;
+  // Max AppendEntries in flight per peer
+  size_t replication_window_;
+  // Limits for single AppendEntries request
+  size_t append_max_entries_;
+  size_t append_max_bytes_;
+
   // log index -> commit channel
   std::map<rsm::RequestId, await::futures::Promise<proto::Response>>
       commit_channels_;
-  std::map<rsm::RequestId, muesli::Bytes> cache_;
+
+  // Admission control, for commands in commit_channels_
+  size_t admitted_bytes_{0};
+  // Client id -> commands in commit_channels_
+  std::map<std::string, size_t> admitted_per_client_;
+  size_t admission_max_entries_;
+  size_t admission_max_bytes_;
+  size_t admission_max_per_client_;
+
+  // Apply domain, see lock domains above
+  await::fibers::Mutex apply_mutex_;
+  // Guarded by apply_mutex_
+  SessionTable sessions_;
+  size_t sessions_capacity_;
+
+  // Initial learners, promoted ones are in promotions_ too
+  std::set<std::string> learners_;
+  // Log index -> learner promoted there, snapshot prefix included
+  std::map<size_t, std::string> promotions_;
+  bool follower_reads_;
+
+  // ReadIndex
+  struct PendingRead {
+    Command command;
+    size_t read_index;
+    // Heartbeat round that must reach a majority
+    size_t round;
+    Promise<proto::Response> promise;
+  };
+  std::deque<PendingRead> pending_reads_;
+  size_t read_round_{0};
+  // Peer -> latest round acknowledged in current term
+  std::map<std::string, size_t> acked_round_;
+  // Follower ReadIndex requests waiting for heartbeat majority
+  struct IndexRead {
+    size_t read_index;
+    size_t round;
+    // 0 if leadership is lost
+    Promise<size_t> promise;
+  };
+  std::deque<IndexRead> index_reads_;
+
+  // Leader lease and CheckQuorum
+  bool lease_reads_;
+  // Peer -> send time of latest acknowledged request in current term
+  std::map<std::string, node::time::MonotonicTime> acked_at_;
+  node::time::MonotonicTime leader_since_{0};
+  node::time::MonotonicTime leader_contact_{0};
+
+  // Replies of outdated pre-vote rounds are ignored
+  size_t pre_vote_round_{0};
+
+  RaftMetrics metrics_;
+  // Commit index -> time it was reached, until applied
+  std::deque<std::pair<size_t, node::time::MonotonicTime>> commit_times_;
+
+  // Leadership transfer in progress
+  std::optional<std::string> transfer_target_;
+  node::time::MonotonicTime transfer_started_{0};
+  bool timeout_now_sent_{false};
+  bool lease_revoked_{false};
+
+  // Commands accepted by leader but not yet appended to log_
+  LogEntries batch_;
+  size_t batch_bytes_{0};
+  // Bumped on each flush, stale flush timers are ignored
+  uint64_t batch_id_{0};
+  Jiffies batch_delay_;
+  size_t batch_max_entries_;
+  size_t batch_max_bytes_;
 
   size_t commit_index_{0};
-  size_t persisted_commit_index_{0};
+  size_t last_applied_{0};
+
+  // Applier
+  await::fibers::Channel<int> apply_channel_{1};
+  size_t apply_batch_size_;
+  // State from InstallSnapshot RPC waiting for applier
+  std::optional<muesli::Bytes> pending_install_;
+  // Bumped on each installed snapshot, applier drops stale results
+  // Written with both mutex_ and apply_mutex_, read with either
+  uint64_t install_epoch_{0};
+
+  // Applied entries kept in log before compaction
+  size_t snapshot_threshold_;
+  // Max bytes of snapshot in single InstallSnapshot request
+  size_t snapshot_chunk_size_;
+
+  // Snapshot domain, see lock domains above
+  await::fibers::Mutex snapshot_mutex_;
+  // Snapshot received from leader chunk by chunk
+  struct IncomingSnapshot {
+    uint64_t term{0};
+    uint64_t index{0};
+    muesli::Bytes data;
+  };
+  IncomingSnapshot incoming_;
 
   node::time::MonotonicTime election_reset_event_{0};
+  Jiffies election_timeout_{0};
+  // Peer -> RTT of link, measured on AppendEntries replies across terms
+  std::map<std::string, RttEstimator> peer_rtt_;
+  // Estimate of link to current leader, reported by leader
+  uint64_t link_rtt_{0};
+  // Bounds of RTT estimate, percents of net.rtt
+  uint64_t rtt_min_percent_;
+  uint64_t rtt_max_percent_;
+  // Wakes parked election timer after step down
+  await::fibers::Channel<int> election_timer_channel_{1};
+
+  timber::Logger logger_;
+};
+
+//////////////////////////////////////////////////////////////////////
+
+// Raft groups hosted by this replica, see raft.groups config
+// Commands are routed to groups by IStateMachine::ShardKey, groups share
+// one RPC service and one heartbeat timer, AppendEntries of all groups
+// to the same peer (entries and heartbeats alike) are coalesced into
+// a single message
+
+class RaftGroups : public IReplica,
+                   public commute::rpc::ServiceBase<RaftGroups>,
+                   public node::cluster::Peer,
+                   public std::enable_shared_from_this<RaftGroups> {
+ public:
+  RaftGroups(const StateMachineFactory& state_machines,
+             const persist::fs::Path& store_dir)
+      : Peer(node::rt::Config()),
+        router_(state_machines()),
+        logger_("RaftGroups", node::rt::LoggerBackend()) {
+    size_t count = node::rt::Config()->GetInt<size_t>("raft.groups");
+    for (size_t group = 0; group < count; ++group) {
+      groups_.push_back(std::make_shared<Raft>(
+          group, count, state_machines(),
+          store_dir / ("group-" + std::to_string(group)),
+          [this](const std::string& peer, Raft::OutgoingAppend append) {
+            Post(peer, std::move(append));
+          }));
+    }
+  }
+
+  Future<proto::Response> Execute(Command command) override {
+    return groups_[GroupOf(*router_, command, groups_.size())]->Execute(
+        std::move(command));
+  }
+
+  void Start() {
+    for (auto& group : groups_) {
+      group->Start();
+    }
+    await::fibers::Go([&, self{shared_from_this()}]() {
+      RunHeartbeats();
+    });
+    LOG_INFO("Started {} raft groups", groups_.size());
+  }
+
+ protected:
+  // RPC handlers
+
+  void RegisterMethods() override {
+    COMMUTE_RPC_REGISTER_HANDLER(RequestVote);
+    COMMUTE_RPC_REGISTER_HANDLER(AppendEntries);
+    COMMUTE_RPC_REGISTER_HANDLER(AppendBatch);
+    COMMUTE_RPC_REGISTER_HANDLER(InstallSnapshot);
+    COMMUTE_RPC_REGISTER_HANDLER(TransferLeadership);
+    COMMUTE_RPC_REGISTER_HANDLER(TimeoutNow);
+    COMMUTE_RPC_REGISTER_HANDLER(PromoteLearner);
+    COMMUTE_RPC_REGISTER_HANDLER(ReadIndex);
+    COMMUTE_RPC_REGISTER_HANDLER(Metrics);
+  }
+
+  void RequestVote(const raft::proto::RequestVote::Request& request,
+                   raft::proto::RequestVote::Response* response) {
+    Dispatch(&Raft::RequestVote, request, response);
+  }
+
+  void AppendEntries(const raft::proto::AppendEntries::Request& request,
+                     raft::proto::AppendEntries::Response* response) {
+    Dispatch(&Raft::AppendEntries, request, response);
+  }
+
+  void AppendBatch(const raft::proto::AppendBatch::Request& request,
+                   raft::proto::AppendBatch::Response* response) {
+    for (const auto& append : request.appends) {
+      Dispatch(&Raft::AppendEntries, append, &response->acks.emplace_back());
+    }
+  }
+
+  void InstallSnapshot(const raft::proto::InstallSnapshot::Request& request,
+                       raft::proto::InstallSnapshot::Response* response) {
+    Dispatch(&Raft::InstallSnapshot, request, response);
+  }
+
+  void TransferLeadership(
+      const raft::proto::TransferLeadership::Request& request,
+      raft::proto::TransferLeadership::Response* response) {
+    Dispatch(&Raft::TransferLeadership, request, response);
+  }
+
+  void TimeoutNow(const raft::proto::TimeoutNow::Request& request,
+                  raft::proto::TimeoutNow::Response* response) {
+    Dispatch(&Raft::TimeoutNow, request, response);
+  }
+
+  void PromoteLearner(const raft::proto::PromoteLearner::Request& request,
+                      raft::proto::PromoteLearner::Response* response) {
+    Dispatch(&Raft::PromoteLearner, request, response);
+  }
+
+  void ReadIndex(const raft::proto::ReadIndex::Request& request,
+                 raft::proto::ReadIndex::Response* response) {
+    Dispatch(&Raft::ReadIndex, request, response);
+  }
+
+  void Metrics(const raft::proto::Metrics::Request& request,
+               RaftMetrics* response) {
+    Dispatch(&Raft::Metrics, request, response);
+  }
+
+ private:
+  // Group id comes from the network: request for unknown group is
+  // answered with unknown_group set, see raft::proto
+  template <typename Request, typename Response>
+  void Dispatch(void (Raft::*handler)(const Request&, Response*),
+                const Request& request, Response* response) {
+    if (!Known(request.group)) {
+      response->unknown_group = true;
+      return;
+    }
+    (*groups_[request.group].*handler)(request, response);
+  }
+
+  bool Known(size_t group) const {
+    if (group < groups_.size()) {
+      return true;
+    }
+    LOG_INFO("Reject request for unknown raft group {}, check raft.groups "
+             "config",
+             group);
+    return false;
+  }
+
+  // Single heartbeat timer for all groups
+  void RunHeartbeats() {
+    while (true) {
+      // Fastest group paces the shared timer
+      auto interval = groups_.front()->HeartbeatTimerInterval();
+      for (auto& group : groups_) {
+        interval = std::min(interval, group->HeartbeatTimerInterval());
+      }
+      node::rt::SleepFor(interval);
+      for (auto& group : groups_) {
+        group->SendHeartbeats(interval);
+      }
+    }
+  }
+
+  // Outbox
+
+  // With mutex of sending group
+  // Appends to the same peer are collected until the flushing fiber
+  // started by the first of them runs, i.e. until the sender yields
+  void Post(const std::string& peer, Raft::OutgoingAppend append) {
+    std::lock_guard guard{outbox_mutex_};
+    auto& pending = outbox_[peer];
+    pending.push_back(std::move(append));
+    if (pending.size() == 1) {
+      await::fibers::Go([&, peer, self{shared_from_this()}]() {
+        Flush(peer);
+      });
+    }
+  }
+
+  void Flush(const std::string& peer) {
+    std::vector<Raft::OutgoingAppend> batch;
+    {
+      std::lock_guard guard{outbox_mutex_};
+      batch.swap(outbox_[peer]);
+    }
+
+    std::vector<std::optional<raft::proto::AppendEntries::Response>> acks(
+        batch.size());
+    if (batch.size() == 1) {
+      auto result = await::fibers::Await(
+          commute::rpc::Call("Raft.AppendEntries")
+              .Args(batch.front().request)
+              .Via(Peer::Channel(peer))
+              .Start()
+              .As<raft::proto::AppendEntries::Response>());
+      if (result.IsOk()) {
+        acks.front() = result.ValueOrThrow();
+      }
+    } else {
+      raft::proto::AppendBatch::Request request;
+      for (const auto& append : batch) {
+        request.appends.push_back(append.request);
+      }
+      auto result =
+          await::fibers::Await(commute::rpc::Call("Raft.AppendBatch")
+                                   .Args(request)
+                                   .Via(Peer::Channel(peer))
+                                   .Start()
+                                   .As<raft::proto::AppendBatch::Response>());
+      if (result.IsOk()) {
+        auto response = result.ValueOrThrow();
+        for (size_t i = 0; i < batch.size() && i < response.acks.size();
+             ++i) {
+          acks[i] = std::move(response.acks[i]);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (acks[i].has_value() && acks[i]->unknown_group) {
+        acks[i].reset();
+      }
+      groups_[batch[i].request.group]->HandleAppendEntriesReply(
+          peer, batch[i], acks[i]);
+    }
+  }
+
+ private:
+  // Only ShardKey is called
+  IStateMachinePtr router_;
+  std::vector<std::shared_ptr<Raft>> groups_;
 
-  await::fibers::Channel<int> trigger_ae_channel_{1};
+  // Lock order: mutex of any group -> outbox_mutex_
+  await::fibers::Mutex outbox_mutex_;
+  // Peer -> appends of all groups not sent yet
+  std::map<std::string, std::vector<Raft::OutgoingAppend>> outbox_;
 
   timber::Logger logger_;
 };
 
 //////////////////////////////////////////////////////////////////////
 
-IReplicaPtr MakeRaftReplica(IStateMachinePtr state_machine,
+IReplicaPtr MakeRaftReplica(StateMachineFactory state_machines,
                             commute::rpc::IServer* server) {
   auto store_dir =
       node::rt::Fs()->MakePath(node::rt::Config()->GetString("rsm.store.dir"));
@@ -622,11 +2285,10 @@ IReplicaPtr MakeRaftReplica(IStateMachinePtr state_machine,
   auto db_path = node::rt::Config()->GetString("db.path");
   node::rt::Database()->Open(db_path);
 
-  auto replica =
-      std::make_shared<Raft>(std::move(state_machine), std::move(store_dir));
+  auto replica = std::make_shared<RaftGroups>(state_machines, store_dir);
   server->RegisterService("Raft", replica);
 
-  replica->Start(server);
+  replica->Start();
   return replica;
 }
 
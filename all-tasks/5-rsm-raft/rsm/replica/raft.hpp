@@ -7,7 +7,7 @@
 
 namespace rsm {
 
-IReplicaPtr MakeRaftReplica(IStateMachinePtr state_machine,
+IReplicaPtr MakeRaftReplica(StateMachineFactory state_machines,
                             commute::rpc::IServer* server);
 
 }  // namespace rsm
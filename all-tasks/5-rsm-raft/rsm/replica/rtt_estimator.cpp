@@ -0,0 +1,18 @@
+#include <rsm/replica/rtt_estimator.hpp>
+
+namespace rsm {
+
+void RttEstimator::Add(uint64_t sample) {
+  if (samples_++ == 0) {
+    smoothed_ = sample;
+    deviation_ = sample / 2;
+    return;
+  }
+  uint64_t error =
+      sample > smoothed_ ? sample - smoothed_ : smoothed_ - sample;
+  // Gains 1/4 for deviation and 1/8 for smoothed RTT
+  deviation_ = (3 * deviation_ + error) / 4;
+  smoothed_ = (7 * smoothed_ + sample) / 8;
+}
+
+}  // namespace rsm
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rsm {
+
+// Moving estimate of round-trip time of a single link
+// Smoothed RTT and mean deviation as in TCP retransmission timer
+// (RFC 6298), in jiffies
+
+class RttEstimator {
+ public:
+  void Add(uint64_t sample);
+
+  bool HasSamples() const {
+    return samples_ > 0;
+  }
+
+  // Smoothed RTT plus jitter margin, 0 without samples
+  uint64_t Estimate() const {
+    return smoothed_ + 4 * deviation_;
+  }
+
+ private:
+  uint64_t samples_{0};
+  uint64_t smoothed_{0};
+  uint64_t deviation_{0};
+};
+
+}  // namespace rsm
@@ -0,0 +1,71 @@
+#include <rsm/replica/sessions.hpp>
+
+#include <algorithm>
+
+namespace rsm {
+
+std::optional<muesli::Bytes> SessionTable::Find(const RequestId& id) const {
+  auto session = sessions_.find(id.client_id);
+  if (session == sessions_.end()) {
+    return std::nullopt;
+  }
+  if (id.index <= session->second.acked_index) {
+    return muesli::Bytes{};
+  }
+  auto response = session->second.responses.find(id.index);
+  if (response == session->second.responses.end()) {
+    return std::nullopt;
+  }
+  return response->second;
+}
+
+SessionTable::Status SessionTable::Admit(const Command& command,
+                                        size_t capacity) {
+  const auto& id = command.request_id;
+  auto it = sessions_.find(id.client_id);
+  if (it == sessions_.end()) {
+    if (command.type != kOpenSession) {
+      return Status::Expired;
+    }
+    it = sessions_.emplace(id.client_id, Session{}).first;
+  } else {
+    activity_.erase(it->second.last_active);
+  }
+  auto& session = it->second;
+
+  session.last_active = ++clock_;
+  activity_.emplace(session.last_active, id.client_id);
+
+  session.acked_index = std::max(session.acked_index, command.acked_index);
+  session.responses.erase(session.responses.begin(),
+                          session.responses.upper_bound(session.acked_index));
+
+  // Most recently active session survives
+  Evict(capacity);
+
+  if (Find(id).has_value()) {
+    return Status::Duplicate;
+  }
+  return Status::New;
+}
+
+void SessionTable::Record(const Command& command, muesli::Bytes response) {
+  const auto& id = command.request_id;
+  auto it = sessions_.find(id.client_id);
+  if (it == sessions_.end()) {
+    return;
+  }
+  if (id.index > it->second.acked_index) {
+    it->second.responses[id.index] = std::move(response);
+  }
+}
+
+void SessionTable::Evict(size_t capacity) {
+  while (sessions_.size() > std::max<size_t>(capacity, 1)) {
+    auto oldest = activity_.begin();
+    sessions_.erase(oldest->second);
+    activity_.erase(oldest);
+  }
+}
+
+}  // namespace rsm
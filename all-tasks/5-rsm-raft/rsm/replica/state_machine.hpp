@@ -3,9 +3,11 @@
 #include <rsm/client/command.hpp>
 
 #include <muesli/bytes.hpp>
+#include <muesli/serialize.hpp>
 
 #include <string>
 #include <memory>
+#include <functional>
 
 namespace rsm {
 
@@ -25,8 +27,31 @@ struct IStateMachine {
 
   virtual muesli::Bytes MakeSnapshot() = 0;
   virtual void InstallSnapshot(muesli::Bytes snapshot) = 0;
+
+  // Sharding
+
+  // Commands with equal keys are routed to the same Raft group
+  // Depends only on command, not on state
+  virtual std::string ShardKey(const Command& command) = 0;
 };
 
 using IStateMachinePtr = std::shared_ptr<IStateMachine>;
 
+// Makes state machine in initial state, one per Raft group
+using StateMachineFactory = std::function<IStateMachinePtr()>;
+
+// Raft group of command, see raft.groups config
+// Shared by replicas and proxies, router is used only for ShardKey
+inline size_t GroupOf(IStateMachine& router, const Command& command,
+                      size_t groups) {
+  if (groups == 1) {
+    return 0;
+  }
+  if (command.type == kOpenSession) {
+    auto request = muesli::Deserialize<OpenSessionRequest>(command.request);
+    return request.group % groups;
+  }
+  return std::hash<std::string>{}(router.ShardKey(command)) % groups;
+}
+
 }  // namespace rsm
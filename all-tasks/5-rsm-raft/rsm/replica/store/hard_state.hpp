@@ -0,0 +1,30 @@
+#pragma once
+
+#include <muesli/serializable.hpp>
+
+#include <cereal/types/string.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace rsm {
+
+// Raft state that must survive restarts, stored as one atomic record
+
+struct HardState {
+  uint64_t term{0};
+  // Empty if not voted in term
+  std::string voted_for;
+
+  MUESLI_SERIALIZABLE(term, voted_for)
+};
+
+inline bool operator==(const HardState& lhs, const HardState& rhs) {
+  return lhs.term == rhs.term && lhs.voted_for == rhs.voted_for;
+}
+
+inline bool operator!=(const HardState& lhs, const HardState& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace rsm
@@ -4,51 +4,212 @@
 
 #include <muesli/serialize.hpp>
 
+#include <mutex>
+
 namespace rsm {
 
 Log::Log(persist::fs::IFileSystem* fs, const persist::fs::Path& store_dir)
     : impl_(MakeLogImpl(fs, store_dir)) {
 }
 
-void Log::Open() {
+void Log::Open(LogBase base) {
+  std::lock_guard impl_guard{impl_mutex_};
+  std::lock_guard read_guard{read_mutex_};
   impl_->Open();
+
+  std::lock_guard guard{mutex_};
+  base_ = base;
+  durable_length_ = impl_->Length() + base_.offset;
+
+  term_index_.Clear();
+  for (size_t index = base_.index + 1; index <= durable_length_; ++index) {
+    auto entry = muesli::Deserialize<LogEntry>(impl_->Read(ToImplIndex(index)));
+    term_index_.Append(index, entry.term);
+  }
 }
 
 LogEntry Log::Read(size_t index) const {
-  auto bytes = impl_->Read(index);
-  return muesli::Deserialize<LogEntry>(bytes);
+  return muesli::Deserialize<LogEntry>(ReadRaw(index).bytes);
+}
+
+RawLogEntry Log::ReadRaw(size_t index) const {
+  {
+    std::lock_guard guard{mutex_};
+    if (index > durable_length_) {
+      return staged_[index - durable_length_ - 1];
+    }
+  }
+  // Durable entries are never rewritten by appends, so disk writes in
+  // progress do not block the read
+  std::lock_guard read_guard{read_mutex_};
+  auto bytes = impl_->Read(ToImplIndex(index));
+  std::lock_guard guard{mutex_};
+  return {term_index_.Term(index), std::move(bytes)};
 }
 
 size_t Log::Length() const {
-  return impl_->Length();
+  std::lock_guard guard{mutex_};
+  return durable_length_ + staged_.size();
+}
+
+size_t Log::DurableLength() const {
+  std::lock_guard guard{mutex_};
+  return durable_length_;
 }
 
 uint64_t Log::Term(size_t index) const {
-  return Read(index).term;
+  std::lock_guard guard{mutex_};
+  if (index == base_.index) {
+    return base_.term;
+  }
+  return term_index_.Term(index);
 }
 
 uint64_t Log::LastLogTerm() const {
-  size_t length = Length();
-  if (length == 0) {
-    return 0;
+  std::lock_guard guard{mutex_};
+  if (durable_length_ + staged_.size() == base_.index) {
+    return base_.term;
   }
-  return Read(length).term;
+  return term_index_.LastTerm();
+}
+
+size_t Log::FirstIndexOfTerm(uint64_t term) const {
+  std::lock_guard guard{mutex_};
+  return term_index_.FirstIndexOf(term);
+}
+
+size_t Log::LastIndexOfTerm(uint64_t term) const {
+  std::lock_guard guard{mutex_};
+  return term_index_.LastIndexOf(term);
 }
 
 void Log::Append(const LogEntries& entries, size_t start_offset) {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
   persist::rsm::raft::Entries persist_entries;
   for (size_t i = start_offset; i < entries.size(); ++i) {
     persist_entries.push_back(muesli::Serialize(entries[i]));
   }
   impl_->Append(persist_entries);
+
+  std::lock_guard guard{mutex_};
+  for (size_t i = start_offset; i < entries.size(); ++i) {
+    term_index_.Append(++durable_length_, entries[i].term);
+  }
+}
+
+void Log::Stage(const LogEntries& entries) {
+  std::lock_guard guard{mutex_};
+  size_t index = durable_length_ + staged_.size();
+  for (const auto& entry : entries) {
+    staged_.push_back({entry.term, muesli::Serialize(entry)});
+    term_index_.Append(++index, entry.term);
+  }
+}
+
+void Log::Persist() {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+}
+
+bool Log::Writing() const {
+  std::lock_guard guard{mutex_};
+  return writing_;
+}
+
+void Log::PersistStaged() {
+  persist::rsm::raft::Entries persist_entries;
+  {
+    // Staged entries stay readable while they are written
+    std::lock_guard guard{mutex_};
+    for (const auto& entry : staged_) {
+      persist_entries.push_back(entry.bytes);
+    }
+    writing_ = !persist_entries.empty();
+  }
+  if (persist_entries.empty()) {
+    return;
+  }
+  impl_->Append(persist_entries);
+
+  // Only Stage runs concurrently, it appends past written entries
+  std::lock_guard guard{mutex_};
+  writing_ = false;
+  staged_.erase(staged_.begin(), staged_.begin() + persist_entries.size());
+  durable_length_ += persist_entries.size();
+}
+
+void Log::Append(const RawLogEntries& entries, size_t start_offset) {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
+  persist::rsm::raft::Entries persist_entries;
+  for (size_t i = start_offset; i < entries.size(); ++i) {
+    persist_entries.push_back(entries[i].bytes);
+  }
+  impl_->Append(persist_entries);
+
+  std::lock_guard guard{mutex_};
+  for (size_t i = start_offset; i < entries.size(); ++i) {
+    term_index_.Append(++durable_length_, entries[i].term);
+  }
 }
 
 void Log::TruncateSuffix(size_t from_index) {
-  impl_->TruncateSuffix(from_index);
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
+  std::lock_guard read_guard{read_mutex_};
+  impl_->TruncateSuffix(ToImplIndex(from_index));
+
+  std::lock_guard guard{mutex_};
+  term_index_.TruncateSuffix(from_index);
+  durable_length_ = from_index - 1;
+}
+
+LogBase Log::BaseAt(size_t index) const {
+  std::lock_guard guard{mutex_};
+  return {index, index == base_.index ? base_.term : term_index_.Term(index),
+          base_.offset};
+}
+
+void Log::TruncatePrefix(size_t index) {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
+  if (index <= base_.index) {
+    return;
+  }
+  std::lock_guard read_guard{read_mutex_};
+  // Drops file log entries before the given one
+  impl_->TruncatePrefix(ToImplIndex(index + 1));
+
+  std::lock_guard guard{mutex_};
+  base_ = {index, term_index_.Term(index), base_.offset};
+  term_index_.TruncatePrefix(index);
 }
 
-void Log::TruncatePrefix(size_t end_index) {
-  impl_->TruncatePrefix(end_index);
+LogBase Log::ResetBase(size_t index, uint64_t term) {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
+  // File log keeps its numbering: every entry it holds precedes new base
+  return {index, term, index - impl_->Length()};
+}
+
+void Log::Reset(LogBase base) {
+  std::lock_guard impl_guard{impl_mutex_};
+  PersistStaged();
+
+  std::lock_guard read_guard{read_mutex_};
+  // Every file log entry precedes new base and is covered by snapshot
+  impl_->TruncatePrefix(base.index + 1 - base.offset);
+
+  std::lock_guard guard{mutex_};
+  base_ = base;
+  durable_length_ = base_.index;
+  term_index_.Clear();
 }
 
 std::shared_ptr<Log::ILogImpl> Log::MakeLogImpl(
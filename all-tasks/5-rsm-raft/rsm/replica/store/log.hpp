@@ -1,48 +1,124 @@
 #pragma once
 
+#include <rsm/replica/store/log_base.hpp>
 #include <rsm/replica/store/log_entry.hpp>
+#include <rsm/replica/store/term_index.hpp>
 
 #include <persist/fs/path.hpp>
 #include <persist/rsm/raft/log/log.hpp>
 
+#include <await/fibers/sync/mutex.hpp>
+
 namespace rsm {
 
 // Persistent log
-// Indexed from 1
-// NOT thread safe, external synchronization required
+// Indexed from 1, entries up to Base().index are compacted into snapshot
+// Log domain: Persist() may run concurrently with any other operation,
+// other operations require external synchronization
+// Reads of durable entries do not wait for appends in progress
+// Lock order: write mutex, read mutex, in-memory state mutex
 
 class Log {
  public:
   Log(persist::fs::IFileSystem* fs, const persist::fs::Path& store_dir);
 
   // One-shot
-  void Open();
+  // base is persisted by the owner along with the snapshot
+  void Open(LogBase base = {});
 
+  // Base().index < index <= Length()
   LogEntry Read(size_t index) const;
 
+  // Same as Read, but entry is not deserialized
+  RawLogEntry ReadRaw(size_t index) const;
+
+  // Index of the last entry, staged entries included
   size_t Length() const;
 
+  // Index of the last entry written to disk
+  size_t DurableLength() const;
+
   // Append entries[start_offset:]
   void Append(const LogEntries& entries, size_t start_offset = 0);
+  void Append(const RawLogEntries& entries, size_t start_offset = 0);
+
+  // Write-behind for leader: staged entries are readable right away,
+  // so they can be replicated while Persist() writes them to disk
+  void Stage(const LogEntries& entries);
+  void Persist();
 
+  // Persist() is writing staged entries, for metrics
+  bool Writing() const;
+
+  // Operations below write staged entries first
+
+  // from_index > Base().index
   void TruncateSuffix(size_t from_index);
 
+  // Served from in-memory term index, no disk reads
+  // Base().index <= index <= Length(), 0 otherwise
   uint64_t Term(size_t index) const;
 
   // For leader election
   uint64_t LastLogTerm() const;
 
+  // For conflict resolution, 0 if term is not present in the log
+  size_t FirstIndexOfTerm(uint64_t term) const;
+  size_t LastIndexOfTerm(uint64_t term) const;
+
   // Compaction
+
+  LogBase Base() const {
+    return base_;
+  }
+
+  // Base after TruncatePrefix(index)
+  // Persist it with the snapshot before truncating
+  LogBase BaseAt(size_t index) const;
+
+  // Drop entries up to index (inclusive)
   void TruncatePrefix(size_t index);
 
+  // Drop all entries, next appended entry gets index + 1, in two steps:
+  // ResetBase writes staged entries and returns new base, persist it with
+  // the snapshot, then Reset(base) drops the entries
+  // Log must not be appended to in between
+  // File log entries are renumbered to precede the new base, so a crash
+  // before the snapshot is persisted leaves the old log intact
+  LogBase ResetBase(size_t index, uint64_t term);
+  void Reset(LogBase base);
+
  private:
   using ILogImpl = persist::rsm::raft::IContinuousLog;
 
   std::shared_ptr<ILogImpl> MakeLogImpl(persist::fs::IFileSystem* fs,
                                         const persist::fs::Path& store_dir);
 
+  size_t ToImplIndex(size_t index) const {
+    return index - base_.offset;
+  }
+
+  // With impl_mutex_
+  void PersistStaged();
+
  private:
+  // Serializes writes to impl_, held during disk writes
+  mutable await::fibers::Mutex impl_mutex_;
+  // Guards durable entries of impl_: taken by reads and by writes that
+  // drop or renumber entries. Appends go past DurableLength() and leave
+  // readable entries in place, so they skip it
+  mutable await::fibers::Mutex read_mutex_;
   std::shared_ptr<ILogImpl> impl_;
+
+  // Guards in-memory state below, never held during disk writes
+  // base_ and durable_length_ change only with impl_mutex_ held too
+  mutable await::fibers::Mutex mutex_;
+  LogBase base_;
+  TermIndex term_index_;
+  size_t durable_length_{0};
+  // Entries (DurableLength(), Length()]
+  RawLogEntries staged_;
+  bool writing_{false};
 };
 
 }  // namespace rsm
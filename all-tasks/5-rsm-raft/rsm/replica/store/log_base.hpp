@@ -0,0 +1,22 @@
+#pragma once
+
+#include <muesli/serializable.hpp>
+
+#include <cstdint>
+
+namespace rsm {
+
+// Position of the log relative to the latest snapshot
+
+struct LogBase {
+  // Last index / term covered by snapshot
+  uint64_t index{0};
+  uint64_t term{0};
+
+  // Log index = index in underlying file log + offset
+  uint64_t offset{0};
+
+  MUESLI_SERIALIZABLE(index, term, offset)
+};
+
+}  // namespace rsm
@@ -2,6 +2,7 @@
 
 #include <rsm/client/command.hpp>
 
+#include <muesli/bytes.hpp>
 #include <muesli/serializable.hpp>
 #include <cereal/types/vector.hpp>
 
@@ -18,4 +19,17 @@ struct LogEntry {
 
 using LogEntries = std::vector<LogEntry>;
 
+// Serialized LogEntry as stored on disk + term header
+// Replicated from leader log to follower log without decoding
+struct RawLogEntry {
+  uint64_t term;
+  muesli::Bytes bytes;
+  // Membership change, set by leader, followers decode only such entries
+  bool config{false};
+
+  MUESLI_SERIALIZABLE(term, bytes, config)
+};
+
+using RawLogEntries = std::vector<RawLogEntry>;
+
 }  // namespace rsm
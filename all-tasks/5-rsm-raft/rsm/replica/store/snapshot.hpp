@@ -0,0 +1,34 @@
+#pragma once
+
+#include <rsm/replica/sessions.hpp>
+#include <rsm/replica/store/log_base.hpp>
+
+#include <muesli/bytes.hpp>
+#include <muesli/serializable.hpp>
+
+#include <cereal/types/map.hpp>
+#include <cereal/types/string.hpp>
+
+#include <map>
+
+namespace rsm {
+
+// State machine snapshot with everything needed to replace log prefix
+
+struct Snapshot {
+  // Log position right after snapshot
+  LogBase log_base;
+
+  // IStateMachine::MakeSnapshot
+  muesli::Bytes state;
+
+  // Client sessions for exactly-once semantics
+  SessionTable sessions;
+
+  // Log index -> learner promoted by membership change at this index
+  std::map<uint64_t, std::string> promotions;
+
+  MUESLI_SERIALIZABLE(log_base, state, sessions, promotions)
+};
+
+}  // namespace rsm
@@ -0,0 +1,110 @@
+#include <rsm/replica/store/term_index.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+namespace rsm {
+
+void TermIndex::Clear() {
+  runs_.clear();
+  last_index_ = 0;
+}
+
+void TermIndex::Append(size_t index, uint64_t term) {
+  if (runs_.empty() || runs_.back().term != term) {
+    runs_.push_back({index, term});
+  }
+  last_index_ = index;
+}
+
+void TermIndex::TruncateSuffix(size_t from_index) {
+  if (from_index > last_index_) {
+    return;
+  }
+  while (!runs_.empty() && runs_.back().first_index >= from_index) {
+    runs_.pop_back();
+  }
+  last_index_ = from_index - 1;
+}
+
+void TermIndex::TruncatePrefix(size_t index) {
+  if (index >= last_index_) {
+    Clear();
+    // Keep numbering for subsequent appends
+    last_index_ = index;
+    return;
+  }
+  auto first_kept = FindRun(index + 1);
+  if (first_kept == runs_.end()) {
+    return;  // Already truncated
+  }
+  runs_.erase(runs_.begin(), first_kept);
+  runs_.front().first_index = index + 1;
+}
+
+uint64_t TermIndex::Term(size_t index) const {
+  auto run = FindRun(index);
+  if (run == runs_.end()) {
+    return 0;
+  }
+  return run->term;
+}
+
+uint64_t TermIndex::LastTerm() const {
+  if (runs_.empty()) {
+    return 0;
+  }
+  return runs_.back().term;
+}
+
+size_t TermIndex::FirstIndexOf(uint64_t term) const {
+  auto run = FindTerm(term);
+  if (run == runs_.end()) {
+    return 0;
+  }
+  return run->first_index;
+}
+
+size_t TermIndex::LastIndexOf(uint64_t term) const {
+  auto run = FindTerm(term);
+  if (run == runs_.end()) {
+    return 0;
+  }
+  return RunEnd(run);
+}
+
+std::vector<TermIndex::Run>::const_iterator TermIndex::FindRun(
+    size_t index) const {
+  if (runs_.empty() || index < runs_.front().first_index ||
+      index > last_index_) {
+    return runs_.end();
+  }
+  // First run starting after index
+  auto next = std::upper_bound(runs_.begin(), runs_.end(), index,
+                               [](size_t i, const Run& run) {
+                                 return i < run.first_index;
+                               });
+  return std::prev(next);
+}
+
+std::vector<TermIndex::Run>::const_iterator TermIndex::FindTerm(
+    uint64_t term) const {
+  auto run = std::lower_bound(runs_.begin(), runs_.end(), term,
+                              [](const Run& run, uint64_t t) {
+                                return run.term < t;
+                              });
+  if (run == runs_.end() || run->term != term) {
+    return runs_.end();
+  }
+  return run;
+}
+
+size_t TermIndex::RunEnd(std::vector<Run>::const_iterator run) const {
+  auto next = std::next(run);
+  if (next == runs_.end()) {
+    return last_index_;
+  }
+  return next->first_index - 1;
+}
+
+}  // namespace rsm
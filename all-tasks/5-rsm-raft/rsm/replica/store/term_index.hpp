@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace rsm {
+
+// In-memory run-length index of log entry terms
+// Terms in the log are non-decreasing, so each term occupies one run
+// NOT thread safe, external synchronization required
+
+class TermIndex {
+ public:
+  void Clear();
+
+  // index == LastIndex() + 1
+  void Append(size_t index, uint64_t term);
+
+  // Drop [from_index, LastIndex()]
+  void TruncateSuffix(size_t from_index);
+
+  // Drop entries up to index (inclusive)
+  void TruncatePrefix(size_t index);
+
+  // 0 for indices outside of the log
+  uint64_t Term(size_t index) const;
+
+  size_t LastIndex() const {
+    return last_index_;
+  }
+
+  uint64_t LastTerm() const;
+
+  // 0 if term is not present in the log
+  size_t FirstIndexOf(uint64_t term) const;
+  size_t LastIndexOf(uint64_t term) const;
+
+ private:
+  struct Run {
+    size_t first_index;
+    uint64_t term;
+  };
+
+  // Run containing index, runs_.end() if none
+  std::vector<Run>::const_iterator FindRun(size_t index) const;
+  // Run with given term, runs_.end() if none
+  std::vector<Run>::const_iterator FindTerm(uint64_t term) const;
+
+  // Last index of the run
+  size_t RunEnd(std::vector<Run>::const_iterator run) const;
+
+ private:
+  std::vector<Run> runs_;
+  size_t last_index_{0};
+};
+
+}  // namespace rsm
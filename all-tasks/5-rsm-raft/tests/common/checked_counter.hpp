@@ -0,0 +1,73 @@
+#pragma once
+
+#include <kv/client.hpp>
+
+#include <matrix/world/global/vars.hpp>
+
+#include <algorithm>
+
+namespace tests {
+
+// Atomic counter that checks reads: counter only grows, so a read below
+// the value this client has already observed is stale (linearizability
+// violation), counted in "stale_reads" global counter
+
+class CheckedCounter {
+  using CounterType = uint64_t;
+
+ public:
+  CheckedCounter(kv::Client& client, const std::string& name)
+      : client_(client), key_(name) {
+  }
+
+  size_t FetchAdd(CounterType d) {
+    while (true) {
+      size_t current = Get();
+      if (Cas(current, current + d) == current) {
+        observed_ = std::max(observed_, current + d);
+        return current;
+      }
+    }
+  }
+
+  CounterType Get() {
+    return Observe(FromValue(client_.Get(key_)));
+  }
+
+ private:
+  CounterType Cas(CounterType expected, CounterType target) {
+    kv::Value prev_value =
+        client_.Cas(key_, ToValue(expected), ToValue(target));
+    return Observe(FromValue(prev_value));
+  }
+
+  CounterType Observe(CounterType value) {
+    if (value < observed_) {
+      whirl::matrix::GlobalCounter("stale_reads").Increment();
+    }
+    observed_ = std::max(observed_, value);
+    return value;
+  }
+
+  static CounterType FromValue(kv::Value value) {
+    if (value.empty()) {
+      return 0;
+    }
+    return std::stoi(value);
+  }
+
+  static kv::Value ToValue(CounterType value) {
+    if (value == 0) {
+      return "";
+    }
+    return std::to_string(value);
+  }
+
+ private:
+  kv::Client& client_;
+  std::string key_;
+  // Largest value read or written by this client
+  CounterType observed_{0};
+};
+
+}  // namespace tests
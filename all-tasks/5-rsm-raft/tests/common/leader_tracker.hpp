@@ -1,12 +1,21 @@
 #pragma once
 
+#include <rsm/replica/proto/raft.hpp>
+
 #include <matrix/fault/listener.hpp>
 #include <matrix/fault/access.hpp>
 
 #include <commute/rpc/wire.hpp>
 
+#include <muesli/serialize.hpp>
+
+#include <map>
 #include <optional>
 
+// Tracks leader of each raft group: sender of AppendEntries for the group
+// in the highest term seen. Coalesced heartbeats make the sender a leader
+// only of groups listed in the batch
+
 class LeaderTracker {
  public:
   LeaderTracker(uint16_t rpc_port)
@@ -15,18 +24,30 @@ class LeaderTracker {
   }
 
   void Reset() {
-    leader_.reset();
+    leaders_.clear();
   }
 
-  std::optional<std::string> Track() {
+  std::optional<std::string> Track(uint64_t group = 0) {
     while (listener_.FrameCount() > frame_index_) {
       const auto& frame = listener_.GetFrame(frame_index_++);
       Process(frame);
     }
-    return leader_;
+    auto it = leaders_.find(group);
+    if (it == leaders_.end()) {
+      return std::nullopt;
+    }
+    return it->second.host;
   }
 
  private:
+  using Append = rsm::raft::proto::AppendEntries::Request;
+  using AppendBatch = rsm::raft::proto::AppendBatch::Request;
+
+  struct Leader {
+    uint64_t term;
+    std::string host;
+  };
+
   void Process(const whirl::matrix::net::Frame& frame) {
     if (frame.packet.header.type != whirl::matrix::net::Packet::Type::Data) {
       return;
@@ -38,13 +59,27 @@ class LeaderTracker {
     auto rpc_request =
         muesli::Deserialize<commute::rpc::proto::Request>(frame.packet.message);
     if (rpc_request.method.name == "AppendEntries") {
-      leader_.emplace(frame.header.source_host);
+      auto append = muesli::Deserialize<Append>(rpc_request.input);
+      Observe(append, frame.header.source_host);
+    } else if (rpc_request.method.name == "AppendBatch") {
+      auto batch = muesli::Deserialize<AppendBatch>(rpc_request.input);
+      for (const auto& append : batch.appends) {
+        Observe(append, frame.header.source_host);
+      }
+    }
+  }
+
+  void Observe(const Append& append, const std::string& source) {
+    auto it = leaders_.find(append.group);
+    if (it != leaders_.end() && it->second.term > append.term) {
+      return;  // Deposed leader
     }
+    leaders_[append.group] = {append.term, source};
   }
 
  private:
   const uint16_t rpc_port_;
   whirl::matrix::fault::INetworkListener& listener_;
   size_t frame_index_ = 0;
-  std::optional<std::string> leader_;
-};
\ No newline at end of file
+  std::map<uint64_t, Leader> leaders_;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <rsm/replica/proto/raft.hpp>
+
+#include <commute/rpc/call.hpp>
+
+#include <await/fibers/sync/future.hpp>
+
+#include <string>
+
+namespace tests {
+
+// Raft admin RPCs, sent to some replica of the pool (first Raft group)
+// Only leader accepts them, callers retry
+
+inline bool PromoteLearner(commute::rpc::IChannelPtr channel,
+                           const std::string& learner) {
+  auto response = await::fibers::Await(
+      commute::rpc::Call("Raft.PromoteLearner")
+          .Args(rsm::raft::proto::PromoteLearner::Request{learner})
+          .Via(channel)
+          .Start()
+          .As<rsm::raft::proto::PromoteLearner::Response>());
+  return response.IsOk() && response->accepted;
+}
+
+// Hands leadership over to most up-to-date follower
+// Returns transfer target, empty if request was rejected
+inline std::string TransferLeadership(commute::rpc::IChannelPtr channel) {
+  auto response = await::fibers::Await(
+      commute::rpc::Call("Raft.TransferLeadership")
+          .Args(rsm::raft::proto::TransferLeadership::Request{})
+          .Via(channel)
+          .Start()
+          .As<rsm::raft::proto::TransferLeadership::Response>());
+  if (!response.IsOk()) {
+    return "";
+  }
+  return response->target;
+}
+
+}  // namespace tests
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <rsm/replica/metrics.hpp>
+#include <rsm/replica/proto/raft.hpp>
+
+#include <commute/rpc/call.hpp>
+
+#include <await/fibers/sync/future.hpp>
+
+#include <matrix/world/global/vars.hpp>
+
+#include <timber/log.hpp>
+
+#include <optional>
+
+namespace tests {
+
+// Metrics snapshot of some replica (first Raft group)
+
+inline std::optional<rsm::RaftMetrics> QueryRaftMetrics(
+    commute::rpc::IChannelPtr channel) {
+  auto metrics =
+      await::fibers::Await(commute::rpc::Call("Raft.Metrics")
+                               .Args(rsm::raft::proto::Metrics::Request{})
+                               .Via(channel)
+                               .Start()
+                               .As<rsm::RaftMetrics>());
+  if (!metrics.IsOk() || metrics->unknown_group) {
+    return std::nullopt;
+  }
+  return *metrics;
+}
+
+// Checks that gauges agree with each other and with config, each
+// violation is counted in "metrics_violations" global counter
+
+inline void CheckRaftMetrics(const rsm::RaftMetrics& metrics,
+                             size_t sessions_capacity,
+                             timber::Logger& logger_) {
+  auto violation = [&](const char* what) {
+    LOG_INFO("Raft metrics violation: {}", what);
+    whirl::matrix::GlobalCounter("metrics_violations").Increment();
+  };
+
+  if (metrics.last_applied > metrics.commit_index) {
+    violation("last_applied > commit_index");
+  }
+  if (metrics.commit_index > metrics.log_length) {
+    violation("commit_index > log_length");
+  }
+  if (metrics.sessions > sessions_capacity) {
+    violation("sessions > rsm.sessions.capacity");
+  }
+
+  if (metrics.state != "Leader") {
+    // Replication gauges are filled only on leader
+    for (const auto& [_, peer] : metrics.peers) {
+      if (peer.next_index + peer.match_index + peer.lag + peer.in_flight >
+          0) {
+        violation("replication gauges on follower");
+      }
+    }
+    return;
+  }
+
+  if (metrics.term == 0) {
+    violation("leader in term 0");
+  }
+  if (metrics.peers.empty()) {
+    violation("leader without peers");
+  }
+  for (const auto& [_, peer] : metrics.peers) {
+    if (peer.match_index > metrics.log_length) {
+      violation("match_index > log_length");
+    }
+    if (peer.lag != metrics.log_length - peer.match_index) {
+      violation("lag != log_length - match_index");
+    }
+    if (peer.next_index <= peer.match_index ||
+        peer.next_index > metrics.log_length + 1) {
+      violation("next_index out of (match_index, log_length + 1]");
+    }
+    if (peer.in_flight > peer.append_entries_sent) {
+      violation("in_flight > append_entries_sent");
+    }
+  }
+}
+
+}  // namespace tests
@@ -1,6 +1,5 @@
 #include <kv/client.hpp>
 #include <kv/main.hpp>
-#include <rsm/proxy/main.hpp>
 
 // Node
 #include <whirl/node/runtime/shortcuts.hpp>
@@ -40,11 +39,14 @@
 #include <tests/time_models/async_1.hpp>
 
 #include "../common/atomic_counter.hpp"
+#include "../common/raft_metrics.hpp"
 
 using namespace whirl;
 
 //////////////////////////////////////////////////////////////////////
 
+static const size_t kMetricsSamples = 32;
+
 void Client() {
   await::fibers::self::SetName("main");
 
@@ -71,6 +73,32 @@ void Client() {
 
     node::rt::SleepFor(node::rt::RandomNumber(1, 100));
   }
+
+  // Post-mortem: sample random replicas until both leader and follower
+  // metrics are checked
+  auto replicas = matrix::client::MakeRpcChannel(
+      "rsm", node::rt::Config()->GetInt<uint16_t>("rpc.port"));
+  size_t sessions_capacity =
+      node::rt::Config()->GetInt<size_t>("rsm.sessions.capacity");
+
+  bool leader_checked = false;
+  bool follower_checked = false;
+  for (size_t i = 0; i < kMetricsSamples; ++i) {
+    if (auto metrics = tests::QueryRaftMetrics(replicas)) {
+      LOG_INFO("Raft metrics: {}", *metrics);
+      tests::CheckRaftMetrics(*metrics, sessions_capacity, logger_);
+      if (metrics->state == "Leader") {
+        leader_checked = true;
+      } else {
+        follower_checked = true;
+      }
+    }
+    if (leader_checked && follower_checked) {
+      break;
+    }
+    node::rt::SleepFor(node::rt::RandomNumber(10, 50));
+  }
+  matrix::GlobalCounter("metrics_dumps").Increment();
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -137,7 +165,7 @@ size_t RunSimulation(size_t seed) {
 
   // Cluster
   world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
-  world.MakePool("proxy", rsm::ProxyMain).Size(2);
+  world.MakePool("proxy", kv::ProxyMain).Size(2);
 
   // Clients
   world.AddClients(Client, /*count=*/clients);
@@ -157,17 +185,41 @@ size_t RunSimulation(size_t seed) {
 
   world.InitCounter("increments");
   world.InitCounter("total");
+  world.InitCounter("metrics_dumps");
+  world.InitCounter("metrics_violations");
 
   // For proxies
   world.SetGlobal<std::string>("config.rsm.pool.name", "rsm");
 
   // For rsm
   world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
+
+  // For raft
+  world.SetGlobal<int64_t>("config.raft.groups", 1);
+  world.SetGlobal<int64_t>("config.raft.replication.window", 4);
+  world.SetGlobal<int64_t>("config.raft.append.max_entries", 16);
+  world.SetGlobal<int64_t>("config.raft.append.max_bytes", 16 * 1024);
+  world.SetGlobal<int64_t>("config.raft.batch.delay", 5);
+  world.SetGlobal<int64_t>("config.raft.batch.max_entries", 64);
+  world.SetGlobal<int64_t>("config.raft.batch.max_bytes", 64 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_entries", 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_bytes", 1024 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_per_client", 8);
+  world.SetGlobal<int64_t>("config.raft.rtt.min_percent", 50);
+  world.SetGlobal<int64_t>("config.raft.rtt.max_percent", 400);
+  world.SetGlobal<int64_t>("config.raft.apply.batch_size", 64);
+  world.SetGlobal<int64_t>("config.raft.snapshot.threshold", 16);
+  world.SetGlobal<int64_t>("config.raft.snapshot.chunk", 128);
+  world.SetGlobal<int64_t>("config.raft.read.lease", 0);
+  world.SetGlobal<int64_t>("config.raft.read.followers", 1);
+  world.SetGlobal<int64_t>("config.raft.learners", 0);
 
   // Run simulation
 
   world.Start();
-  while (world.GetCounter("increments") < increments &&
+  while ((world.GetCounter("increments") < increments ||
+          world.GetCounter("metrics_dumps") < clients) &&
          world.TimeElapsed() < kTimeLimit) {
     if (!world.Step()) {
       break;  // Deadlock
@@ -210,7 +262,12 @@ size_t RunSimulation(size_t seed) {
   runner.Verbose() << "Total = " << total << ", expected = " << total_expected
                    << std::endl;
 
-  const bool correct = total == total_expected;
+  const size_t metrics_violations = world.GetCounter("metrics_violations");
+
+  runner.Verbose() << "Metrics violations = " << metrics_violations
+                   << std::endl;
+
+  const bool correct = total == total_expected && metrics_violations == 0;
 
   if (!correct) {
     // Log
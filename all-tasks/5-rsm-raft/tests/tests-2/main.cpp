@@ -1,6 +1,5 @@
 #include <kv/client.hpp>
 #include <kv/main.hpp>
-#include <rsm/proxy/main.hpp>
 
 // Node
 #include <whirl/node/runtime/shortcuts.hpp>
@@ -43,6 +42,7 @@
 #include <tests/time_models/async_1.hpp>
 
 #include "../common/atomic_counter.hpp"
+#include "../common/leader_tracker.hpp"
 
 using namespace whirl;
 
@@ -145,42 +145,23 @@ void NodeAdversary() {
 //////////////////////////////////////////////////////////////////////
 
 void LeaderAdversary() {
-  timber::Logger logger_{"Net-Listener", node::rt::LoggerBackend()};
-
-  auto& listener = matrix::fault::NetworkListener();
-
-  size_t frame_index = 0;
+  timber::Logger logger_{"Leader-Adversary", node::rt::LoggerBackend()};
 
   uint16_t rpc_port = node::rt::Config()->GetInt<uint16_t>("rpc.port");
+  size_t groups = node::rt::Config()->GetInt<size_t>("raft.groups");
+
+  LeaderTracker leader_tracker(rpc_port);
 
   while (matrix::GlobalNow() < kNoMoreFaults) {
-    std::optional<std::string> leader;
-
-    while (listener.FrameCount() > frame_index) {
-      const auto& frame = listener.GetFrame(frame_index++);
-
-      LOG_INFO("Message sent from {}:{} to {}:{}", frame.header.source_host,
-               frame.packet.header.source_port, frame.header.dest_host,
-               frame.packet.header.dest_port);
-
-      if (frame.packet.header.type != matrix::net::Packet::Type::Data) {
-        continue;
-      }
-      if (frame.packet.header.dest_port != rpc_port) {
-        continue;
-      }
-      // RPC request!
-      auto rpc_request = muesli::Deserialize<commute::rpc::proto::Request>(
-          frame.packet.message);
-      if (rpc_request.method.name == "AppendEntries") {
-        LOG_INFO("AppendEntries sent by {}", frame.header.source_host);
-        leader.emplace(frame.header.source_host);
-      }
-    }
+    // Idle followers get coalesced heartbeats of all groups, so sender of
+    // a message is a leader only of groups it carries
+    uint64_t group = node::rt::RandomNumber(groups);
+    auto leader = leader_tracker.Track(group);
 
     if (leader.has_value()) {
-      LOG_INFO("Reboot leader {}", *leader);
+      LOG_INFO("Reboot leader {} of group {}", *leader, group);
       matrix::fault::Server(*leader).FastReboot();
+      leader_tracker.Reset();
     }
 
     node::rt::SleepFor(10_jfs);
@@ -251,7 +232,7 @@ size_t RunSimulation(size_t seed) {
 
   // Cluster
   world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
-  world.MakePool("proxy", rsm::ProxyMain).Size(2);
+  world.MakePool("proxy", kv::ProxyMain).Size(2);
 
   // Clients
   world.AddClients(Client, /*count=*/clients);
@@ -292,6 +273,27 @@ size_t RunSimulation(size_t seed) {
 
   // For rsm
   world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
+
+  // For raft
+  world.SetGlobal<int64_t>("config.raft.groups", 2);
+  world.SetGlobal<int64_t>("config.raft.replication.window", 4);
+  world.SetGlobal<int64_t>("config.raft.append.max_entries", 16);
+  world.SetGlobal<int64_t>("config.raft.append.max_bytes", 16 * 1024);
+  world.SetGlobal<int64_t>("config.raft.batch.delay", 5);
+  world.SetGlobal<int64_t>("config.raft.batch.max_entries", 64);
+  world.SetGlobal<int64_t>("config.raft.batch.max_bytes", 64 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_entries", 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_bytes", 1024 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_per_client", 8);
+  world.SetGlobal<int64_t>("config.raft.rtt.min_percent", 50);
+  world.SetGlobal<int64_t>("config.raft.rtt.max_percent", 400);
+  world.SetGlobal<int64_t>("config.raft.apply.batch_size", 64);
+  world.SetGlobal<int64_t>("config.raft.snapshot.threshold", 16);
+  world.SetGlobal<int64_t>("config.raft.snapshot.chunk", 128);
+  world.SetGlobal<int64_t>("config.raft.read.lease", 1);
+  world.SetGlobal<int64_t>("config.raft.read.followers", 0);
+  world.SetGlobal<int64_t>("config.raft.learners", 0);
 
   // Run simulation
 
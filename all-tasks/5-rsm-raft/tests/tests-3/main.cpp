@@ -1,6 +1,5 @@
 #include <kv/client.hpp>
 #include <kv/main.hpp>
-#include <rsm/proxy/main.hpp>
 
 // Node
 #include <whirl/node/runtime/shortcuts.hpp>
@@ -281,7 +280,7 @@ size_t RunSimulation(size_t seed) {
 
   // Cluster
   world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
-  world.MakePool("proxy", rsm::ProxyMain).Size(2);
+  world.MakePool("proxy", kv::ProxyMain).Size(2);
 
   // Clients
   world.AddClients(Client, /*count=*/clients);
@@ -322,6 +321,27 @@ size_t RunSimulation(size_t seed) {
 
   // For rsm
   world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
+
+  // For raft
+  world.SetGlobal<int64_t>("config.raft.groups", 1);
+  world.SetGlobal<int64_t>("config.raft.replication.window", 4);
+  world.SetGlobal<int64_t>("config.raft.append.max_entries", 16);
+  world.SetGlobal<int64_t>("config.raft.append.max_bytes", 16 * 1024);
+  world.SetGlobal<int64_t>("config.raft.batch.delay", 5);
+  world.SetGlobal<int64_t>("config.raft.batch.max_entries", 64);
+  world.SetGlobal<int64_t>("config.raft.batch.max_bytes", 64 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_entries", 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_bytes", 1024 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_per_client", 8);
+  world.SetGlobal<int64_t>("config.raft.rtt.min_percent", 50);
+  world.SetGlobal<int64_t>("config.raft.rtt.max_percent", 400);
+  world.SetGlobal<int64_t>("config.raft.apply.batch_size", 64);
+  world.SetGlobal<int64_t>("config.raft.snapshot.threshold", 16);
+  world.SetGlobal<int64_t>("config.raft.snapshot.chunk", 128);
+  world.SetGlobal<int64_t>("config.raft.read.lease", 0);
+  world.SetGlobal<int64_t>("config.raft.read.followers", 0);
+  world.SetGlobal<int64_t>("config.raft.learners", 0);
 
   // Run simulation
 
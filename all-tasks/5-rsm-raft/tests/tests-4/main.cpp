@@ -0,0 +1,290 @@
+#include <kv/client.hpp>
+#include <kv/main.hpp>
+
+// Node
+#include <whirl/node/runtime/shortcuts.hpp>
+
+// Serialization
+#include <muesli/serializable.hpp>
+// Support std::string serialization
+#include <cereal/types/string.hpp>
+
+// Logging
+#include <timber/log.hpp>
+
+// Concurrency
+#include <await/fibers/core/api.hpp>
+#include <await/fibers/sync/future.hpp>
+
+// Simulation
+#include <matrix/facade/world.hpp>
+#include <matrix/world/global/vars.hpp>
+#include <matrix/world/global/time.hpp>
+#include <matrix/client/rpc.hpp>
+#include <matrix/test/random.hpp>
+#include <matrix/test/main.hpp>
+#include <matrix/test/event_log.hpp>
+#include <matrix/test/runner.hpp>
+
+#include <matrix/fault/access.hpp>
+#include <matrix/fault/util.hpp>
+
+#include <matrix/semantics/printers/print.hpp>
+
+#include <commute/rpc/id.hpp>
+#include <commute/rpc/wire.hpp>
+
+#include <muesli/serialize.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include <tests/time_models/async_1.hpp>
+
+#include "../common/checked_counter.hpp"
+#include "../common/leader_tracker.hpp"
+
+using namespace whirl;
+
+// Rebooted follower is asked to vote while leader holds lease renewed by
+// that follower right before reboot. Granting the vote would elect a new
+// leader while the old one still serves lease reads
+
+//////////////////////////////////////////////////////////////////////
+
+void Client() {
+  await::fibers::self::SetName("main");
+
+  node::rt::SleepFor(123_jfs);
+
+  // + Random delay
+  node::rt::SleepFor({node::rt::RandomNumber(50, 100)});
+
+  timber::Logger logger_{"Client", node::rt::LoggerBackend()};
+
+  auto channel = matrix::client::MakeRpcChannel("proxy", 42);
+
+  kv::Client kv_client{channel};
+
+  tests::CheckedCounter counter(kv_client, "counter");
+
+  size_t increments_to_do = matrix::GetGlobal<size_t>("increments_per_client");
+
+  for (size_t i = 0; i < increments_to_do; ++i) {
+    size_t prev_value = counter.FetchAdd(1);
+
+    matrix::GlobalCounter("increments").Increment();
+    matrix::GlobalCounter("total").Add(prev_value);
+
+    // Lease reads
+    size_t reads = node::rt::RandomNumber(1, 5);
+    for (size_t j = 0; j < reads; ++j) {
+      counter.Get();
+      node::rt::SleepFor(node::rt::RandomNumber(1, 50));
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static const matrix::TimePoint kNoMoreFaults = 50000;
+
+//////////////////////////////////////////////////////////////////////
+
+void RebootedVoterAdversary() {
+  timber::Logger logger_{"Rebooted-Voter", node::rt::LoggerBackend()};
+
+  // List system nodes
+  auto pool = node::rt::Discovery()->ListPool("rsm");
+
+  uint16_t rpc_port = node::rt::Config()->GetInt<uint16_t>("rpc.port");
+
+  LeaderTracker leader_tracker(rpc_port);
+
+  while (matrix::GlobalNow() < kNoMoreFaults) {
+    node::rt::SleepFor(10_jfs);
+    auto leader = leader_tracker.Track();
+
+    if (!leader.has_value()) {
+      continue;
+    }
+
+    std::vector<std::string> followers;
+    for (const auto& host : pool) {
+      if (host != *leader) {
+        followers.push_back(host);
+      }
+    }
+    size_t candidate_index = node::rt::RandomNumber(followers.size());
+    auto& candidate = matrix::fault::Server(followers[candidate_index]);
+    auto& voter = matrix::fault::Server(followers[(candidate_index + 1) % 2]);
+
+    // Candidate misses heartbeats, its election timer expires
+    LOG_INFO("Pause {}, leader {}", candidate.Name(), *leader);
+    candidate.Pause();
+    matrix::fault::RandomPause(1000_jfs, 2000_jfs);
+
+    // Voter has just renewed leader lease, candidate asks it for vote
+    // right after reboot
+    LOG_INFO("Reboot {}, resume {}", voter.Name(), candidate.Name());
+    voter.FastReboot();
+    candidate.Resume();
+    leader_tracker.Reset();
+
+    matrix::fault::RandomPause(500_jfs, 1500_jfs);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Seed -> simulation digest
+// Deterministic
+size_t RunSimulation(size_t seed) {
+  auto& runner = matrix::TestRunner::Access();
+
+  static const Jiffies kTimeLimit = 200000_jfs;
+
+  runner.Verbose() << "Simulation seed: " << seed << std::endl;
+
+  matrix::Random random{seed};
+
+  // Leader and two followers: candidate and rebooted voter
+  const size_t replicas = 3;
+
+  // Randomize simulation parameters
+  const size_t clients = random.Get(2, 3);
+  const size_t increments_per_client = random.Get(2, 3);
+
+  size_t increments = increments_per_client * clients;
+
+  runner.Verbose() << "Parameters: "
+                   << "replicas = " << replicas << ", "
+                   << "clients = " << clients << ", "
+                   << "increments_per_client = " << increments_per_client
+                   << std::endl;
+
+  // Reset RPC ids
+  commute::rpc::ResetIds();
+
+  matrix::facade::World world{seed};
+
+  runner.Configure(world);
+
+  world.SetTimeModel(tests::MakeAsyncTimeModel());
+
+  // Cluster
+  world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
+  world.MakePool("proxy", kv::ProxyMain).Size(2);
+
+  // Clients
+  world.AddClients(Client, /*count=*/clients);
+
+  // Adversaries
+
+  world.AddAdversary(RebootedVoterAdversary);
+
+  // Globals
+  world.SetGlobal("increments_per_client", increments_per_client);
+
+  world.InitCounter("increments");
+  world.InitCounter("total");
+  world.InitCounter("stale_reads");
+
+  // For proxies
+  world.SetGlobal<std::string>("config.rsm.pool.name", "rsm");
+
+  // For rsm
+  world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
+
+  // For raft
+  world.SetGlobal<int64_t>("config.raft.groups", 1);
+  world.SetGlobal<int64_t>("config.raft.replication.window", 4);
+  world.SetGlobal<int64_t>("config.raft.append.max_entries", 16);
+  world.SetGlobal<int64_t>("config.raft.append.max_bytes", 16 * 1024);
+  world.SetGlobal<int64_t>("config.raft.batch.delay", 5);
+  world.SetGlobal<int64_t>("config.raft.batch.max_entries", 64);
+  world.SetGlobal<int64_t>("config.raft.batch.max_bytes", 64 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_entries", 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_bytes", 1024 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_per_client", 8);
+  world.SetGlobal<int64_t>("config.raft.rtt.min_percent", 50);
+  world.SetGlobal<int64_t>("config.raft.rtt.max_percent", 400);
+  world.SetGlobal<int64_t>("config.raft.apply.batch_size", 64);
+  world.SetGlobal<int64_t>("config.raft.snapshot.threshold", 16);
+  world.SetGlobal<int64_t>("config.raft.snapshot.chunk", 128);
+  world.SetGlobal<int64_t>("config.raft.read.lease", 1);
+  world.SetGlobal<int64_t>("config.raft.read.followers", 0);
+  world.SetGlobal<int64_t>("config.raft.learners", 0);
+
+  // Run simulation
+
+  world.Start();
+  while (world.GetCounter("increments") < increments &&
+         world.TimeElapsed() < kTimeLimit) {
+    if (!world.Step()) {
+      break;  // Deadlock
+    }
+  }
+
+  // Stop and compute simulation digest
+  size_t digest = world.Stop();
+
+  // Print report
+  runner.Verbose() << "Seed " << seed << " -> "
+                   << "digest: " << digest << ", time: " << world.TimeElapsed()
+                   << ", steps: " << world.StepCount() << std::endl;
+
+  const auto event_log = world.EventLog();
+
+  const bool completed = world.GetCounter("increments") == increments;
+
+  // Time limit exceeded
+  if (!completed) {
+    // Log
+    runner.Report() << "Log:" << std::endl;
+    matrix::WriteTextLog(event_log, runner.Report());
+    runner.Report() << std::endl;
+
+    runner.Report() << "Simulation for seed = " << seed << " failed: ";
+
+    if (world.TimeElapsed() < kTimeLimit) {
+      runner.Report() << "deadlock in simulation" << std::endl;
+    } else {
+      runner.Report() << "time limit exceeded" << std::endl;
+    }
+    runner.Fail();
+  }
+
+  // Check safety properties
+  const size_t total = world.GetCounter("total");
+  const size_t total_expected = increments * (0 + increments - 1) / 2;
+
+  runner.Verbose() << "Total = " << total << ", expected = " << total_expected
+                   << std::endl;
+
+  const size_t stale_reads = world.GetCounter("stale_reads");
+
+  runner.Verbose() << "Stale reads = " << stale_reads << std::endl;
+
+  const bool correct = total == total_expected && stale_reads == 0;
+
+  if (!correct) {
+    // Log
+    runner.Report() << "Log:" << std::endl;
+    matrix::WriteTextLog(event_log, runner.Report());
+    runner.Report() << std::endl;
+
+    // History
+    runner.Report() << "Test invariant VIOLATED for seed = " << seed
+                    << std::endl;
+
+    runner.Fail();
+  }
+
+  return digest;
+}
+
+int main(int argc, const char** argv) {
+  return matrix::Main(argc, argv, RunSimulation);
+}
@@ -0,0 +1,278 @@
+#include <kv/client.hpp>
+#include <kv/main.hpp>
+
+// Node
+#include <whirl/node/runtime/shortcuts.hpp>
+
+// Serialization
+#include <muesli/serializable.hpp>
+// Support std::string serialization
+#include <cereal/types/string.hpp>
+
+// Logging
+#include <timber/log.hpp>
+
+// Concurrency
+#include <await/fibers/core/api.hpp>
+#include <await/fibers/sync/future.hpp>
+
+// Simulation
+#include <matrix/facade/world.hpp>
+#include <matrix/world/global/vars.hpp>
+#include <matrix/world/global/time.hpp>
+#include <matrix/client/rpc.hpp>
+#include <matrix/test/random.hpp>
+#include <matrix/test/main.hpp>
+#include <matrix/test/event_log.hpp>
+#include <matrix/test/runner.hpp>
+
+#include <matrix/fault/access.hpp>
+#include <matrix/fault/util.hpp>
+
+#include <matrix/semantics/printers/print.hpp>
+
+#include <commute/rpc/id.hpp>
+#include <commute/rpc/wire.hpp>
+
+#include <muesli/serialize.hpp>
+
+#include <algorithm>
+
+#include <tests/time_models/async_1.hpp>
+
+#include "../common/atomic_counter.hpp"
+#include "../common/raft_admin.hpp"
+
+using namespace whirl;
+
+// Learner promotion: 3 voters and 1 learner, learner is promoted under
+// load, restarts, then one of the original voters crashes. Quorum is 3
+// of 4 voters from then on, so progress needs the promoted learner
+
+//////////////////////////////////////////////////////////////////////
+
+void Increment(tests::AtomicCounter& counter) {
+  size_t prev_value = counter.FetchAdd(1);
+
+  matrix::GlobalCounter("increments").Increment();
+  matrix::GlobalCounter("total").Add(prev_value);
+}
+
+void Client() {
+  await::fibers::self::SetName("main");
+
+  node::rt::SleepFor(123_jfs);
+
+  // + Random delay
+  node::rt::SleepFor({node::rt::RandomNumber(50, 100)});
+
+  timber::Logger logger_{"Client", node::rt::LoggerBackend()};
+
+  auto channel = matrix::client::MakeRpcChannel("proxy", 42);
+
+  kv::Client kv_client{channel};
+
+  tests::AtomicCounter counter(kv_client, "counter");
+
+  size_t increments_to_do = matrix::GetGlobal<size_t>("increments_per_client");
+
+  for (size_t i = 0; i < increments_to_do; ++i) {
+    Increment(counter);
+
+    node::rt::SleepFor(node::rt::RandomNumber(1, 100));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+static const size_t kIncrementsAfterCrash = 3;
+
+void Promoter() {
+  timber::Logger logger_{"Promoter", node::rt::LoggerBackend()};
+
+  // Learner is the last host of sorted pool, see raft.learners
+  auto pool = node::rt::Discovery()->ListPool("rsm");
+  std::sort(pool.begin(), pool.end());
+  auto learner = pool.back();
+
+  auto replicas = matrix::client::MakeRpcChannel(
+      "rsm", node::rt::Config()->GetInt<uint16_t>("rpc.port"));
+
+  matrix::fault::RandomPause(300_jfs, 1000_jfs);
+
+  // Only caught up learner is promoted, by leader
+  while (!tests::PromoteLearner(replicas, learner)) {
+    node::rt::SleepFor(node::rt::RandomNumber(50, 200));
+  }
+  LOG_INFO("Learner {} promoted", learner);
+
+  // Membership change gets into snapshots
+  matrix::fault::RandomPause(500_jfs, 1500_jfs);
+
+  // Restores membership from snapshot and log
+  LOG_INFO("Reboot promoted learner {}", learner);
+  matrix::fault::Server(learner).FastReboot();
+
+  matrix::fault::RandomPause(500_jfs, 1500_jfs);
+
+  auto& victim =
+      matrix::fault::Server(pool[node::rt::RandomNumber(pool.size() - 1)]);
+  LOG_INFO("Crash voter {}", victim.Name());
+  victim.Crash();
+
+  kv::Client kv_client{matrix::client::MakeRpcChannel("proxy", 42)};
+  tests::AtomicCounter counter(kv_client, "counter");
+  for (size_t i = 0; i < kIncrementsAfterCrash; ++i) {
+    Increment(counter);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+// Seed -> simulation digest
+// Deterministic
+size_t RunSimulation(size_t seed) {
+  auto& runner = matrix::TestRunner::Access();
+
+  static const Jiffies kTimeLimit = 200000_jfs;
+
+  runner.Verbose() << "Simulation seed: " << seed << std::endl;
+
+  matrix::Random random{seed};
+
+  // 3 voters and 1 learner
+  const size_t replicas = 4;
+
+  // Randomize simulation parameters
+  const size_t clients = random.Get(2, 3);
+  const size_t increments_per_client = random.Get(2, 3);
+
+  size_t increments =
+      increments_per_client * clients + kIncrementsAfterCrash;
+
+  runner.Verbose() << "Parameters: "
+                   << "replicas = " << replicas << ", "
+                   << "clients = " << clients << ", "
+                   << "increments_per_client = " << increments_per_client
+                   << std::endl;
+
+  // Reset RPC ids
+  commute::rpc::ResetIds();
+
+  matrix::facade::World world{seed};
+
+  runner.Configure(world);
+
+  world.SetTimeModel(tests::MakeAsyncTimeModel());
+
+  // Cluster
+  world.MakePool("rsm", kv::ReplicaMain).Size(replicas);
+  world.MakePool("proxy", kv::ProxyMain).Size(2);
+
+  // Clients
+  world.AddClients(Client, /*count=*/clients);
+
+  // Adversaries
+
+  world.AddAdversary(Promoter);
+
+  // Globals
+  world.SetGlobal("increments_per_client", increments_per_client);
+
+  world.InitCounter("increments");
+  world.InitCounter("total");
+
+  // For proxies
+  world.SetGlobal<std::string>("config.rsm.pool.name", "rsm");
+
+  // For rsm
+  world.SetGlobal<std::string>("config.rsm.store.dir", "/rsm/store");
+  world.SetGlobal<int64_t>("config.rsm.sessions.capacity", 64);
+
+  // For raft
+  world.SetGlobal<int64_t>("config.raft.groups", 1);
+  world.SetGlobal<int64_t>("config.raft.replication.window", 4);
+  world.SetGlobal<int64_t>("config.raft.append.max_entries", 16);
+  world.SetGlobal<int64_t>("config.raft.append.max_bytes", 16 * 1024);
+  world.SetGlobal<int64_t>("config.raft.batch.delay", 5);
+  world.SetGlobal<int64_t>("config.raft.batch.max_entries", 64);
+  world.SetGlobal<int64_t>("config.raft.batch.max_bytes", 64 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_entries", 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_bytes", 1024 * 1024);
+  world.SetGlobal<int64_t>("config.raft.admission.max_per_client", 8);
+  world.SetGlobal<int64_t>("config.raft.rtt.min_percent", 50);
+  world.SetGlobal<int64_t>("config.raft.rtt.max_percent", 400);
+  world.SetGlobal<int64_t>("config.raft.apply.batch_size", 64);
+  world.SetGlobal<int64_t>("config.raft.snapshot.threshold", 16);
+  world.SetGlobal<int64_t>("config.raft.snapshot.chunk", 128);
+  world.SetGlobal<int64_t>("config.raft.read.lease", 0);
+  world.SetGlobal<int64_t>("config.raft.read.followers", 0);
+  world.SetGlobal<int64_t>("config.raft.learners", 1);
+
+  // Run simulation
+
+  world.Start();
+  while (world.GetCounter("increments") < increments &&
+         world.TimeElapsed() < kTimeLimit) {
+    if (!world.Step()) {
+      break;  // Deadlock
+    }
+  }
+
+  // Stop and compute simulation digest
+  size_t digest = world.Stop();
+
+  // Print report
+  runner.Verbose() << "Seed " << seed << " -> "
+                   << "digest: " << digest << ", time: " << world.TimeElapsed()
+                   << ", steps: " << world.StepCount() << std::endl;
+
+  const auto event_log = world.EventLog();
+
+  const bool completed = world.GetCounter("increments") == increments;
+
+  // Time limit exceeded
+  if (!completed) {
+    // Log
+    runner.Report() << "Log:" << std::endl;
+    matrix::WriteTextLog(event_log, runner.Report());
+    runner.Report() << std::endl;
+
+    runner.Report() << "Simulation for seed = " << seed << " failed: ";
+
+    if (world.TimeElapsed() < kTimeLimit) {
+      runner.Report() << "deadlock in simulation" << std::endl;
+    } else {
+      runner.Report() << "time limit exceeded" << std::endl;
+    }
+    runner.Fail();
+  }
+
+  // Check safety properties
+  const size_t total = world.GetCounter("total");
+  const size_t total_expected = increments * (0 + increments - 1) / 2;
+
+  runner.Verbose() << "Total = " << total << ", expected = " << total_expected
+                   << std::endl;
+
+  const bool correct = total == total_expected;
+
+  if (!correct) {
+    // Log
+    runner.Report() << "Log:" << std::endl;
+    matrix::WriteTextLog(event_log, runner.Report());
+    runner.Report() << std::endl;
+
+    // History
+    runner.Report() << "Test invariant VIOLATED for seed = " << seed
+                    << std::endl;
+
+    runner.Fail();
+  }
+
+  return digest;
+}
+
+int main(int argc, const char** argv) {
+  return matrix::Main(argc, argv, RunSimulation);
+}